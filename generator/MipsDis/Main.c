@@ -0,0 +1,83 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	"MipsDis.h"
+
+static	void	FileSink(void* pUser, const char* pText, size_t iLen)
+{
+	fwrite(pText, 1, iLen, (FILE*)pUser);
+}
+
+void	PrintUsage(void)
+{
+	printf("MipsDis V1.5 by SurfSmurf, Minor updates by Doomed.\n"
+		"Usage: ObjDis [options] file.obj\n"
+		"\n"
+		"Available options:\n"
+		"\t-a : Alternative GTE decoding (for CW)\n");
+
+	exit(0);
+}
+
+int	main(int argc, char* argv[])
+{
+	int		argn = 1;
+	int		alt_gte = 0;
+	int		res = MD_OK;
+	FILE* dest;
+	SMipsDis* pCtx;
+
+	if (argc <= 1)
+		PrintUsage();
+
+	while (argn < argc && argv[argn][0] == '-')
+	{
+		switch (argv[argn][1])
+		{
+		case	'a':
+			alt_gte = 1;
+			break;
+		default:
+			fprintf(stderr, "*ERROR* : Unknown option '%c'\n", argv[argn][1]);
+			return EXIT_FAILURE;
+		}
+		argn += 1;
+	}
+
+	if (argn >= argc)
+		PrintUsage();
+
+	int name_len = strlen(argv[argn]);
+	char* dest_name = (char*)malloc(name_len + 4 + 1);
+	strncpy(dest_name, argv[argn], name_len);
+	dest_name[name_len + 0] = '.';
+	dest_name[name_len + 1] = 'T';
+	dest_name[name_len + 2] = 'X';
+	dest_name[name_len + 3] = 'T';
+	dest_name[name_len + 4] = 0;
+
+	if ((dest = fopen(dest_name, "wb")) == NULL)
+	{
+		fprintf(stderr, "*ERROR* : File \"%s\" not found\n", dest_name);
+		free(dest_name);
+		return EXIT_FAILURE;
+	}
+
+	pCtx = MipsDis_Create(FileSink, dest);
+	MipsDis_SetAltGTE(pCtx, alt_gte);
+
+	if (strstr(argv[argn], ".OBJ") || strstr(argv[argn], ".obj"))
+		res = MipsDis_ParseObj(pCtx, argv[argn]);
+	else if (strstr(argv[argn], ".LIB") || strstr(argv[argn], ".lib"))
+		res = MipsDis_ParseLib(pCtx, argv[argn]);
+
+	if (res != MD_OK)
+		fprintf(stderr, "*ERROR* : %s\n", MipsDis_GetError(pCtx));
+
+	MipsDis_Free(pCtx);
+	fclose(dest);
+	free(dest_name);
+
+	return res == MD_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
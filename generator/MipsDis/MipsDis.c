@@ -8,55 +8,25 @@
 //			Outputs several symbols per address if they exist.
 //			Improved NOP detection
 //			Alternative GTE decoding added for CW output
+// V1.5		Reentrant library: all state lives in SMipsDis, errors are
+//			returned instead of calling exit(), output goes to a sink.
+//			LIB members are parsed in place without temporary files.
+//			Names the target symbol of every relocated jal.
+//			Dumps .data, .rdata and .sdata with relocated bytes masked,
+//			after all code of the OBJ.
+//			Instructions are classified by an opcode table, branch targets
+//			are collected in a bitmap instead of loc_ symbols.
+//			Names the symbol and addend of relocated 16 bit immediates.
 
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<stdarg.h>
 #include	<string.h>
 #include <ctype.h>
+#include	<setjmp.h>
 
 #include	"types.h"
-
-int	OPT_ALTGTE = 0;
-int	iSymbolNumber = 1000000;
-
-FILE* dest = NULL;
-char ttmp[8192];
-
-void	Error(const char* s, ...)
-{
-	char	temp[256];
-	va_list	list;
-
-	va_start(list, s);
-	vsprintf(temp, s, list);
-	fprintf(stderr, "*ERROR* : %s\n", temp);
-	va_end(list);
-	//getchar();
-	exit(EXIT_FAILURE);
-}
-
-ULONG	fgetll(FILE* f)
-{
-	ULONG	r;
-
-	r = fgetc(f);
-	r |= fgetc(f) << 8;
-	r |= fgetc(f) << 16;
-	r |= fgetc(f) << 24;
-
-	return(r);
-}
-
-UWORD	fgetlw(FILE* f)
-{
-	UWORD	r;
-
-	r = fgetc(f);
-	r |= fgetc(f) << 8;
-
-	return(r);
-}
+#include	"MipsDis.h"
 
 typedef	enum
 {
@@ -134,15 +104,116 @@ typedef	struct	_SSection
 	int		oDumped;
 }	SSection;
 
-void	Disassemble(SSection* pSect);
-void	ByteDump(SSection* pSect);
-void	BSSDump(SSection* pSect);
+struct	_SMipsDis
+{
+	int		OPT_ALTGTE;
+	char** pc2dreg;
+	char** pc2creg;
+
+	MipsDisSink	pSink;
+	void* pUser;
+
+	SSection* pSections;
+	ULONG	iSymbolNumber;
+
+	jmp_buf	ErrorJump;
+	char	sError[256];
+
+	char	ttmp[8192];
+};
+
+static	void	Error(SMipsDis* pCtx, int iCode, const char* s, ...)
+{
+	va_list	list;
+
+	va_start(list, s);
+	vsnprintf(pCtx->sError, sizeof(pCtx->sError), s, list);
+	va_end(list);
+
+	longjmp(pCtx->ErrorJump, iCode);
+}
 
-SSymbol* CreateSymbol(SSection* pSect, ESymbolType iType)
+static	void* Alloc(SMipsDis* pCtx, size_t iSize)
+{
+	void* p;
+
+	if ((p = malloc(iSize)) == NULL)
+		Error(pCtx, MD_ERR_MEMORY, "Out of memory");
+
+	return p;
+}
+
+static	void	Write(SMipsDis* pCtx, const char* pText, size_t iLen)
+{
+	pCtx->pSink(pCtx->pUser, pText, iLen);
+}
+
+static	void	Print(SMipsDis* pCtx, const char* s, ...)
+{
+	va_list	list;
+	int		len;
+
+	va_start(list, s);
+	len = vsnprintf(pCtx->ttmp, sizeof(pCtx->ttmp), s, list);
+	va_end(list);
+
+	if (len >= (int)sizeof(pCtx->ttmp))
+		len = sizeof(pCtx->ttmp) - 1;
+
+	if (len > 0)
+		Write(pCtx, pCtx->ttmp, len);
+}
+
+static	ULONG	fgetll(FILE* f)
+{
+	ULONG	r;
+
+	r = fgetc(f);
+	r |= fgetc(f) << 8;
+	r |= fgetc(f) << 16;
+	r |= fgetc(f) << 24;
+
+	return(r);
+}
+
+static	UWORD	fgetlw(FILE* f)
+{
+	UWORD	r;
+
+	r = fgetc(f);
+	r |= fgetc(f) << 8;
+
+	return(r);
+}
+
+static	void	Disassemble(SMipsDis* pCtx, SSection* pSect);
+static	void	ByteDump(SMipsDis* pCtx, SSection* pSect);
+
+static	int		IsDataSection(SSection* pSect)
+{
+	return (strcmp(pSect->sName, ".data") == 0)
+		|| (strcmp(pSect->sName, ".rdata") == 0)
+		|| (strcmp(pSect->sName, ".sdata") == 0);
+}
+
+static	void	DataDump(SMipsDis* pCtx, SSection* pSect)
+{
+	if (pSect->oDumped || pSect->iNumber == 0 || !IsDataSection(pSect))
+		return;
+
+	if (pSect->pData != NULL && pSect->iSize != 0)
+	{
+		Print(pCtx, "\n$DATA_%s:\n", pSect->sName + 1);
+		ByteDump(pCtx, pSect);
+	}
+	pSect->oDumped = 1;
+}
+
+static	SSymbol* CreateSymbol(SMipsDis* pCtx, SSection* pSect, ESymbolType iType)
 {
 	SSymbol* s;
 
-	s = malloc(sizeof(SSymbol));
+	s = Alloc(pCtx, sizeof(SSymbol));
 	s->pNext = pSect->pSymbols;
 	s->Type = iType;
 
@@ -151,11 +222,11 @@ SSymbol* CreateSymbol(SSection* pSect, ESymbolType iType)
 	return s;
 }
 
-SPatch* CreatePatch(SSection* pSect, EPatchType iType)
+static	SPatch* CreatePatch(SMipsDis* pCtx, SSection* pSect, EPatchType iType)
 {
 	SPatch* p;
 
-	p = malloc(sizeof(SPatch));
+	p = Alloc(pCtx, sizeof(SPatch));
 	p->pNext = pSect->pPatches;
 	p->pExpr = NULL;
 	p->Type = iType;
@@ -165,11 +236,11 @@ SPatch* CreatePatch(SSection* pSect, EPatchType iType)
 	return p;
 }
 
-SExpression* Expr_Sub(SExpression* pLeft, SExpression* pRight)
+static	SExpression* Expr_Sub(SMipsDis* pCtx, SExpression* pLeft, SExpression* pRight)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = pLeft;
 	expr->pRight = pRight;
 	expr->Operator = OP_SUB;
@@ -177,11 +248,11 @@ SExpression* Expr_Sub(SExpression* pLeft, SExpression* pRight)
 	return expr;
 }
 
-SExpression* Expr_Constant(SLONG iConst)
+static	SExpression* Expr_Constant(SMipsDis* pCtx, SLONG iConst)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = NULL;
 	expr->pRight = NULL;
 	expr->iValue = iConst;
@@ -190,11 +261,11 @@ SExpression* Expr_Constant(SLONG iConst)
 	return expr;
 }
 
-SExpression* Expr_SectBase(UWORD iSect)
+static	SExpression* Expr_SectBase(SMipsDis* pCtx, UWORD iSect)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = NULL;
 	expr->pRight = NULL;
 	expr->iValue = iSect;
@@ -203,11 +274,11 @@ SExpression* Expr_SectBase(UWORD iSect)
 	return expr;
 }
 
-SExpression* Expr_SectEnd(UWORD iSect)
+static	SExpression* Expr_SectEnd(SMipsDis* pCtx, UWORD iSect)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = NULL;
 	expr->pRight = NULL;
 	expr->iValue = iSect;
@@ -216,11 +287,11 @@ SExpression* Expr_SectEnd(UWORD iSect)
 	return expr;
 }
 
-SExpression* Expr_SectSize(UWORD iSect)
+static	SExpression* Expr_SectSize(SMipsDis* pCtx, UWORD iSect)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = NULL;
 	expr->pRight = NULL;
 	expr->iValue = iSect;
@@ -229,16 +300,16 @@ SExpression* Expr_SectSize(UWORD iSect)
 	return expr;
 }
 
-SExpression* Expr_SectStart(UWORD iSect)
+static	SExpression* Expr_SectStart(SMipsDis* pCtx, UWORD iSect)
 {
-	return Expr_Sub(Expr_SectEnd(iSect), Expr_SectSize(iSect));
+	return Expr_Sub(pCtx, Expr_SectEnd(pCtx, iSect), Expr_SectSize(pCtx, iSect));
 }
 
-SExpression* Expr_AddrOfSymbol(ULONG iSymbol)
+static	SExpression* Expr_AddrOfSymbol(SMipsDis* pCtx, ULONG iSymbol)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = NULL;
 	expr->pRight = NULL;
 	expr->iValue = iSymbol;
@@ -247,11 +318,11 @@ SExpression* Expr_AddrOfSymbol(ULONG iSymbol)
 	return expr;
 }
 
-SExpression* Expr_Add(SExpression* pLeft, SExpression* pRight)
+static	SExpression* Expr_Add(SMipsDis* pCtx, SExpression* pLeft, SExpression* pRight)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = pLeft;
 	expr->pRight = pRight;
 	expr->Operator = OP_ADD;
@@ -259,11 +330,11 @@ SExpression* Expr_Add(SExpression* pLeft, SExpression* pRight)
 	return expr;
 }
 
-SExpression* Expr_Mul(SExpression* pLeft, SExpression* pRight)
+static	SExpression* Expr_Mul(SMipsDis* pCtx, SExpression* pLeft, SExpression* pRight)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = pLeft;
 	expr->pRight = pRight;
 	expr->Operator = OP_MUL;
@@ -271,11 +342,11 @@ SExpression* Expr_Mul(SExpression* pLeft, SExpression* pRight)
 	return expr;
 }
 
-SExpression* Expr_Div(SExpression* pLeft, SExpression* pRight)
+static	SExpression* Expr_Div(SMipsDis* pCtx, SExpression* pLeft, SExpression* pRight)
 {
 	SExpression* expr;
 
-	expr = malloc(sizeof(SExpression));
+	expr = Alloc(pCtx, sizeof(SExpression));
 	expr->pLeft = pLeft;
 	expr->pRight = pRight;
 	expr->Operator = OP_DIV;
@@ -283,46 +354,52 @@ SExpression* Expr_Div(SExpression* pLeft, SExpression* pRight)
 	return expr;
 }
 
-SExpression* ReadExpression(FILE* f)
+static	SExpression* ReadExpression(SMipsDis* pCtx, FILE* f)
 {
 	int	op;
+	SExpression* pLeft;
 
 	op = fgetc(f);
 
 	switch (op)
 	{
 	case	0x00:
-		return Expr_Constant(fgetll(f));
+		return Expr_Constant(pCtx, fgetll(f));
 		break;
 	case	0x02:
-		return Expr_AddrOfSymbol(fgetlw(f));
+		return Expr_AddrOfSymbol(pCtx, fgetlw(f));
 		break;
 	case	0x04:
-		return Expr_SectBase(fgetlw(f));
+		return Expr_SectBase(pCtx, fgetlw(f));
 		break;
 	case	0x0C:
-		return Expr_SectStart(fgetlw(f));
+		return Expr_SectStart(pCtx, fgetlw(f));
 		break;
 	case	0x16:
-		return Expr_SectEnd(fgetlw(f));
+		return Expr_SectEnd(pCtx, fgetlw(f));
 		break;
 	case	0x30:
-		return Expr_Mul(ReadExpression(f), ReadExpression(f));
+		pLeft = ReadExpression(pCtx, f);
+		return Expr_Mul(pCtx, pLeft, ReadExpression(pCtx, f));
 		break;
 	case 0x32:
-		return Expr_Div(ReadExpression(f), ReadExpression(f));
+		pLeft = ReadExpression(pCtx, f);
+		return Expr_Div(pCtx, pLeft, ReadExpression(pCtx, f));
 		break;
 	case 0x36:
-		return Expr_Add(ReadExpression(f), ReadExpression(f));
+		pLeft = ReadExpression(pCtx, f);
+		return Expr_Add(pCtx, pLeft, ReadExpression(pCtx, f));
 		break;
 	case	0x2C:
-		return Expr_Add(ReadExpression(f), ReadExpression(f));
+		pLeft = ReadExpression(pCtx, f);
+		return Expr_Add(pCtx, pLeft, ReadExpression(pCtx, f));
 		break;
 	case 0x2E:
-		return Expr_Sub(ReadExpression(f), ReadExpression(f));
+		pLeft = ReadExpression(pCtx, f);
+		return Expr_Sub(pCtx, pLeft, ReadExpression(pCtx, f));
 		break;
 	default:
-		Error("Unsupported op 0x%02X in patch at 0x%X", op, ftell(f));
+		Error(pCtx, MD_ERR_UNSUPPORTED, "Unsupported op 0x%02X in patch at 0x%lX", op, ftell(f));
 		break;
 	}
 
@@ -333,11 +410,9 @@ SExpression* ReadExpression(FILE* f)
 	return NULL;
 }
 
-SSection* pSections = NULL;
-
-SSection* GetSection(ULONG iID)
+static	SSection* GetSection(SMipsDis* pCtx, ULONG iID)
 {
-	SSection** ppSect = &pSections;
+	SSection** ppSect = &pCtx->pSections;
 
 	while (*ppSect)
 	{
@@ -348,7 +423,8 @@ SSection* GetSection(ULONG iID)
 		ppSect = &((*ppSect)->pNext);
 	}
 
-	*ppSect = malloc(sizeof(SSection));
+	*ppSect = Alloc(pCtx, sizeof(SSection));
+	(*ppSect)->sName[0] = 0;
 	(*ppSect)->pNext = NULL;
 	(*ppSect)->iNumber = iID;
 	(*ppSect)->pData = NULL;
@@ -360,7 +436,7 @@ SSection* GetSection(ULONG iID)
 	return *ppSect;
 }
 
-void	SectionDump(SSection* pSect)
+static	void	SectionDump(SMipsDis* pCtx, SSection* pSect)
 {
 	if (pSect->oDumped)
 		return;
@@ -381,21 +457,16 @@ void	SectionDump(SSection* pSect)
 			|| (strcmp(pSect->sName, ".ctors") == 0)
 			|| (strcmp(pSect->sName, ".dtors") == 0))
 		{
-			Disassemble(pSect);
+			Disassemble(pCtx, pSect);
 			pSect->oDumped = 1;
 		}
-		else if ((strcmp(pSect->sName, ".data") == 0)
-			|| (strcmp(pSect->sName, ".rdata") == 0)
-			|| (strcmp(pSect->sName, ".sdata") == 0))
+		else if (IsDataSection(pSect))
 		{
-			//printf("\n$DATA_%s:\n", pSect->sName + 1);
-			//ByteDump(pSect);
-			pSect->oDumped = 1;
+			//	Dumped by DataDump() once all code is out, code offsets stay the same
 		}
 		else if ((strcmp(pSect->sName, ".sbss") == 0)
 			|| (strcmp(pSect->sName, ".bss") == 0))
 		{
-			//BSSDump(pSect);
 			pSect->oDumped = 1;
 		}
 		else
@@ -406,23 +477,7 @@ void	SectionDump(SSection* pSect)
 	//printf("\n");
 }
 
-char* reg[32] =
-{
-	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
-	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
-	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
-	"t8", "t9", "k0", "k1", "gp", "sp", "s8", "ra"
-};
-
-char* c0reg[32] =
-{
-	"inx", "rand", "tlblo", "bpc", "ctxt", "bda", "pidmask", "dcic",
-	"badvaddr",	"bdam", "tlbhi", "bpcm", "sr", "cause", "epc", "prid",
-	"erreg", "r17", "r18", "r19", "r20", "r21", "r22", "r23",
-	"r24", "r25", "r26", "r27", "r28", "r29", "r30", "r31"
-};
-
-char* psyq_c2dreg[32] =
+static	char* psyq_c2dreg[32] =
 {
 	"vxy0", "vz0", "vxy1", "vz1", "vxy2", "vz2", "rgb", "otz",
 	"ir0", "ir1", "ir2", "ir3", "sxy0", "sxy1", "sxy2", "sxyp",
@@ -430,7 +485,7 @@ char* psyq_c2dreg[32] =
 	"mac0", "mac1", "mac2", "mac3", "irgb", "orgb", "lzcs", "lzcr"
 };
 
-char* psyq_c2creg[32] =
+static	char* psyq_c2creg[32] =
 {
 	"r11r12", "r13r21", "r22r23", "r31r32", "r33", "trx", "try", "trz",
 	"l11l12", "l13l21", "l22l23", "l31l32", "l33", "rbk", "gbk", "bbk",
@@ -438,7 +493,7 @@ char* psyq_c2creg[32] =
 	"ofx","ofy", "h", "dqa", "dqb", "zsf3", "zsf4", "flag"
 };
 
-char* cw_c2dreg[32] =
+static	char* cw_c2dreg[32] =
 {
 	"C2_VXY0", "C2_VZ0", "C2_VXY1", "C2_VZ1", "C2_VXY2", "C2_VZ2", "C2_RGB", "C2_OTZ",
 	"C2_IR0", "C2_IR1", "C2_IR2", "C2_IR3", "C2_SXY0", "C2_SXY1", "C2_SXY2", "C2_SXYP",
@@ -446,7 +501,7 @@ char* cw_c2dreg[32] =
 	"C2_MAC0", "C2_MAC1", "C2_MAC2", "C2_MAC3", "C2_IRGB", "C2_ORGB", "C2_LZCS", "C2_LZCR"
 };
 
-char* cw_c2creg[32] =
+static	char* cw_c2creg[32] =
 {
 	"C2_R11R12", "C2_R13R21", "C2_R22R23", "C2_R31R32", "C2_R33", "C2_TRX", "C2_TRY", "C2_TRZ",
 	"C2_L11L12", "C2_L13L21", "C2_L22L23", "C2_L31L32", "C2_L33", "C2_RBK", "C2_GBK", "C2_BBK",
@@ -454,21 +509,7 @@ char* cw_c2creg[32] =
 	"C2_OFX","C2_OFY", "C2_H", "C2_DQA", "C2_DQB", "C2_ZSF3", "C2_ZSF4", "C2_FLAG"
 };
 
-char** pc2dreg = psyq_c2dreg;
-char** pc2creg = psyq_c2creg;
-
-void	PrintUsage(void)
-{
-	printf("MipsDis V1.4 by SurfSmurf, Minor updates by Doomed.\n"
-		"Usage: ObjDis [options] file.obj\n"
-		"\n"
-		"Available options:\n"
-		"\t-a : Alternative GTE decoding (for CW)\n");
-
-	exit(0);
-}
-
-void	FreeExpression(SExpression* pExpr)
+static	void	FreeExpression(SExpression* pExpr)
 {
 	if (pExpr)
 	{
@@ -478,11 +519,45 @@ void	FreeExpression(SExpression* pExpr)
 	}
 }
 
-void	FixPatchesAndSymbols(void)
+static	void	FreeSections(SMipsDis* pCtx)
+{
+	SSection* pSect;
+
+	pSect = pCtx->pSections;
+	while (pSect)
+	{
+		SSection* pNextSect = pSect->pNext;
+
+		while (pSect->pPatches)
+		{
+			SPatch* pPatch = pSect->pPatches;
+
+			pSect->pPatches = pPatch->pNext;
+			FreeExpression(pPatch->pExpr);
+			free(pPatch);
+		}
+
+		while (pSect->pSymbols)
+		{
+			SSymbol* pSym = pSect->pSymbols;
+
+			pSect->pSymbols = pSym->pNext;
+			free(pSym);
+		}
+
+		free(pSect->pData);
+		free(pSect);
+		pSect = pNextSect;
+	}
+
+	pCtx->pSections = NULL;
+}
+
+static	void	FixPatchesAndSymbols(SMipsDis* pCtx)
 {
 	SSection* pSect;
 
-	pSect = pSections;
+	pSect = pCtx->pSections;
 
 	while (pSect)
 	{
@@ -516,7 +591,7 @@ void	FixPatchesAndSymbols(void)
 					pConstExpr = t;
 				}
 
-				pSymSect = GetSection(pSectExpr->iValue);
+				pSymSect = GetSection(pCtx, pSectExpr->iValue);
 
 				pSym = pSymSect->pSymbols;
 				while (pSym)
@@ -528,14 +603,14 @@ void	FixPatchesAndSymbols(void)
 
 				if (pSym == NULL)
 				{
-					pSym = CreateSymbol(pSymSect, SYM_LOCAL);
-					pSym->iNumber = iSymbolNumber;
+					pSym = CreateSymbol(pCtx, pSymSect, SYM_LOCAL);
+					pSym->iNumber = pCtx->iSymbolNumber;
 					pSym->iOffset = pConstExpr->iValue;
-					sprintf(pSym->sName, "%s_%X", pSymSect->sName + 1, pSym->iOffset);
-					iSymbolNumber += 1;
+					sprintf(pSym->sName, "%s_%lX", pSymSect->sName + 1, pSym->iOffset);
+					pCtx->iSymbolNumber += 1;
 				}
 				FreeExpression(pExpr);
-				pPatch->pExpr = Expr_AddrOfSymbol(pSym->iNumber);
+				pPatch->pExpr = Expr_AddrOfSymbol(pCtx, pSym->iNumber);
 
 			}
 
@@ -545,37 +620,32 @@ void	FixPatchesAndSymbols(void)
 	}
 }
 
-void	FixRelativeJumps(SSection* pSect);
+static	void	ReadName(SMipsDis* pCtx, FILE* f, char* sName)
+{
+	int	len;
+
+	len = fgetc(f);
+	if (len == EOF || fread(sName, 1, len, f) != (size_t)len)
+		Error(pCtx, MD_ERR_FORMAT, "Unexpected end of file at 0x%lX", ftell(f));
+	sName[len] = 0;
+}
 
-void parse_obj(const char* path, const char* dst_path, int from_lib) {
+//	Parses one OBJ starting at the current position of f, up to its end chunk.
+static	void	ParseObjStream(SMipsDis* pCtx, FILE* f, const char* name)
+{
 	SSection* pCurrentSection = NULL;
-	FILE* f;
 	ULONG	id;
 	int		ok = 1;
 	int		totalsections = 0;
 	int		PatchOffset = 0;
 
-	pSections = NULL;
-
-	if ((f = fopen(path, "rb")) == NULL)
-		Error("File \"%s\" not found", path);
-
+	pCtx->pSections = NULL;
 
-	if (!from_lib)
-	{
-		if ((dest = fopen(dst_path, "wb")) == NULL)
-			Error("File \"%s\" not found", dst_path);
-	}
-
-	char* pp = strrchr(path, '/');
-	char* pp2 = strrchr(path, '\\');
-	sprintf(ttmp, "==%s==\n", pp ? &pp[1] : (pp2 ? &pp2[1] : path));
-	fwrite(ttmp, 1, strlen(ttmp), dest);
-	fflush(dest);
+	Print(pCtx, "==%s==\n", name);
 
 	id = fgetll(f);
 	if (id != 0x024B4E4C)
-		Error("Not an object-file");
+		Error(pCtx, MD_ERR_FORMAT, "Not an object-file");
 
 	while (ok)
 	{
@@ -593,10 +663,16 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 		{
 			//	Code
 			int	len;
+			UBYTE* pData;
 
 			len = fgetlw(f);
-			pCurrentSection->pData = realloc(pCurrentSection->pData, pCurrentSection->iSize + len);
-			fread(pCurrentSection->pData + pCurrentSection->iSize, 1, len, f);
+			if (pCurrentSection == NULL)
+				Error(pCtx, MD_ERR_FORMAT, "Code outside of section at 0x%lX", ftell(f));
+			if ((pData = realloc(pCurrentSection->pData, pCurrentSection->iSize + len)) == NULL)
+				Error(pCtx, MD_ERR_MEMORY, "Out of memory");
+			pCurrentSection->pData = pData;
+			if (fread(pCurrentSection->pData + pCurrentSection->iSize, 1, len, f) != (size_t)len)
+				Error(pCtx, MD_ERR_FORMAT, "Unexpected end of file at 0x%lX", ftell(f));
 			pCurrentSection->iSize += len;
 			break;
 		}
@@ -606,16 +682,25 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			int	id;
 
 			id = fgetlw(f);
-			pCurrentSection = GetSection(id);
+			pCurrentSection = GetSection(pCtx, id);
 			PatchOffset = pCurrentSection->iSize;
 			break;
 		}
 		case	8:
 		{
-			//	Uninitialised data
+			//	Uninitialised data, zeroes for the dumps which read up to iSize
 			int	size;
+			UBYTE* pData;
 
 			size = fgetll(f);
+			if (pCurrentSection == NULL)
+				Error(pCtx, MD_ERR_FORMAT, "Data outside of section at 0x%lX", ftell(f));
+			if (size <= 0)
+				break;
+			if ((pData = realloc(pCurrentSection->pData, pCurrentSection->iSize + size)) == NULL)
+				Error(pCtx, MD_ERR_MEMORY, "Out of memory");
+			pCurrentSection->pData = pData;
+			memset(pCurrentSection->pData + pCurrentSection->iSize, 0, size);
 
 			pCurrentSection->iSize += size;
 			break;
@@ -625,7 +710,7 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			//	Patch
 			int			type;
 			int			offset;
-			EPatchType	ntype;
+			EPatchType	ntype = PATCH_LONG;
 			SPatch* p;
 
 			type = fgetc(f);
@@ -657,11 +742,13 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 				ntype = PATCH_MIPSGP;
 				break;
 			default:
-				Error("Patch type %d at 0x%X unsupported", type, ftell(f));
+				Error(pCtx, MD_ERR_UNSUPPORTED, "Patch type %d at 0x%lX unsupported", type, ftell(f));
 			}
-			p = CreatePatch(pCurrentSection, ntype);
+			if (pCurrentSection == NULL)
+				Error(pCtx, MD_ERR_FORMAT, "Patch outside of section at 0x%lX", ftell(f));
+			p = CreatePatch(pCtx, pCurrentSection, ntype);
 			p->iOffset = offset + PatchOffset;
-			p->pExpr = ReadExpression(f);
+			p->pExpr = ReadExpression(pCtx, f);
 
 			break;
 		}
@@ -670,7 +757,6 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			//	XDEF symbol
 			int		number;
 			int		section;
-			int		len;
 			ULONG	offset;
 			SSymbol* pSym;
 
@@ -678,45 +764,37 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			section = fgetlw(f);
 			offset = fgetll(f);
 
-			pSym = CreateSymbol(GetSection(section), SYM_XDEF);
+			pSym = CreateSymbol(pCtx, GetSection(pCtx, section), SYM_XDEF);
 			pSym->iOffset = offset;
 			pSym->iNumber = number;
-			len = fgetc(f);
-			fread(pSym->sName, 1, len, f);
-			pSym->sName[len] = 0;
+			ReadName(pCtx, f, pSym->sName);
 			break;
 		}
 		case	14:
 		{
 			//	XREF symbol
 			int		number;
-			int		len;
 
 			SSymbol* pSym;
 
 			number = fgetlw(f);
 
-			pSym = CreateSymbol(GetSection(0), SYM_XREF);
+			pSym = CreateSymbol(pCtx, GetSection(pCtx, 0), SYM_XREF);
 			pSym->iNumber = number;
-			len = fgetc(f);
-			fread(pSym->sName, 1, len, f);
-			pSym->sName[len] = 0;
+			ReadName(pCtx, f, pSym->sName);
 			break;
 		}
 		case	16:
 		{
 			//	Create section
 			SSection* pSect;
-			int			len;
 			int			id;
 
-			pSect = GetSection(id = fgetlw(f));
+			pSect = GetSection(pCtx, id = fgetlw(f));
 			pSect->iGroup = fgetc(f);	//	GROUP
 			pSect->iAlign = fgetlw(f);	//	ALIGNMENT
 
-			len = fgetc(f);
-			fread(pSect->sName, 1, len, f);
-			pSect->sName[len] = 0;
+			ReadName(pCtx, f, pSect->sName);
 
 			if (id > totalsections)
 			{
@@ -728,28 +806,24 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 		{
 			//	LOCAL symbol
 			int		section;
-			int		len;
 			ULONG	offset;
 			SSymbol* pSym;
 
 			section = fgetlw(f);
 			offset = fgetll(f);
 
-			pSym = CreateSymbol(GetSection(section), SYM_LOCAL);
+			pSym = CreateSymbol(pCtx, GetSection(pCtx, section), SYM_LOCAL);
 			pSym->iOffset = offset;
-			pSym->iNumber = iSymbolNumber++;
-			len = fgetc(f);
-			fread(pSym->sName, 1, len, f);
-			pSym->sName[len] = 0;
+			pSym->iNumber = pCtx->iSymbolNumber++;
+			ReadName(pCtx, f, pSym->sName);
 			break;
 		}
 		case	28:
 		{
 			//	File number and name
-			int	number;
 			int	len;
 
-			number = fgetlw(f);
+			fgetlw(f);
 			len = fgetc(f);
 			fseek(f, len, SEEK_CUR);
 
@@ -762,7 +836,7 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			int	cpu;
 			cpu = fgetc(f);
 			if (cpu != 7)
-				Error("CPU type %d not supported", cpu);
+				Error(pCtx, MD_ERR_UNSUPPORTED, "CPU type %d not supported", cpu);
 			break;
 		}
 		case	48:
@@ -770,7 +844,6 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			//	XBSS symbol
 			int		number;
 			int		section;
-			int		len;
 			ULONG	size;
 			SSymbol* pSym;
 			SSection* pSect;
@@ -779,16 +852,14 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 			section = fgetlw(f);
 			size = fgetll(f);
 
-			pSect = GetSection(section);
+			pSect = GetSection(pCtx, section);
 
-			pSym = CreateSymbol(pSect, SYM_XBSS);
+			pSym = CreateSymbol(pCtx, pSect, SYM_XBSS);
 			pSym->iOffset = pSect->iSize;
 			pSym->iSize = size;
 			pSect->iSize += size;
 			pSym->iNumber = number;
-			len = fgetc(f);
-			fread(pSym->sName, 1, len, f);
-			pSym->sName[len] = 0;
+			ReadName(pCtx, f, pSym->sName);
 			break;
 
 		}
@@ -800,102 +871,71 @@ void parse_obj(const char* path, const char* dst_path, int from_lib) {
 		case 74:
 		{
 			// function start
-			int section;
-			int offset;
-			int file;
-			int start_line;
-			int frame_reg;
-			int frame_size;
-			int ret_pc_reg;
-			int mask;
-			int mask_off;
-			int len;
 			char name[256];
 
-			section = fgetlw(f);
-			offset = fgetll(f);
-			file = fgetlw(f);
-			start_line = fgetll(f);
-			frame_reg = fgetlw(f);
-			frame_size = fgetll(f);
-			ret_pc_reg = fgetlw(f);
-			mask = fgetll(f);
-			mask_off = fgetll(f);
+			fgetlw(f);	//	section
+			fgetll(f);	//	offset
+			fgetlw(f);	//	file
+			fgetll(f);	//	start line
+			fgetlw(f);	//	frame reg
+			fgetll(f);	//	frame size
+			fgetlw(f);	//	return pc reg
+			fgetll(f);	//	mask
+			fgetll(f);	//	mask offset
 
-			len = fgetc(f);
-			fread(name, 1, len, f);
-			name[len] = 0;
+			ReadName(pCtx, f, name);
 
 			break;
 		}
 		case 76:
 		{
-			int section;
-			int offset;
-			int end_line;
-
-			section = fgetlw(f);
-			offset = fgetll(f);
-			end_line = fgetll(f);
+			fgetlw(f);	//	section
+			fgetll(f);	//	offset
+			fgetll(f);	//	end line
 
 			break;
 		}
 		default:
-			Error("Chunk %d at 0x%X not supported", chunk, ftell(f));
+			Error(pCtx, MD_ERR_UNSUPPORTED, "Chunk %d at 0x%lX not supported", chunk, ftell(f));
 		}
 	}
 
-	FixPatchesAndSymbols();
-	SectionDump(GetSection(0));
-	pCurrentSection = pSections;
-	while (pCurrentSection)
-	{
-		if (strcmp(pCurrentSection->sName, ".text") == 0)
-		{
-			FixRelativeJumps(pCurrentSection);
-		}
-		pCurrentSection = pCurrentSection->pNext;
-	}
+	FixPatchesAndSymbols(pCtx);
+	SectionDump(pCtx, GetSection(pCtx, 0));
 
-	pCurrentSection = pSections;
+	pCurrentSection = pCtx->pSections;
 	while (pCurrentSection)
 	{
 		if ((pCurrentSection->iNumber != 0)
 			&& ((strcmp(pCurrentSection->sName, ".sbss") == 0)
 				|| (strcmp(pCurrentSection->sName, ".sdata") == 0)))
 		{
-			SectionDump(pCurrentSection);
+			SectionDump(pCtx, pCurrentSection);
 		}
 		pCurrentSection = pCurrentSection->pNext;
 	}
 
-	pCurrentSection = pSections;
+	pCurrentSection = pCtx->pSections;
 	while (pCurrentSection)
 	{
 		if (pCurrentSection->iNumber != 0)
 		{
-			SectionDump(pCurrentSection);
+			SectionDump(pCtx, pCurrentSection);
 		}
 		pCurrentSection = pCurrentSection->pNext;
 	}
 
-	//getchar();
-
-	pCurrentSection = pSections;
+	pCurrentSection = pCtx->pSections;
 	while (pCurrentSection)
 	{
-		SSection* ptr = pCurrentSection->pNext;
-		free(pCurrentSection);
-		pCurrentSection = ptr;
+		DataDump(pCtx, pCurrentSection);
+		pCurrentSection = pCurrentSection->pNext;
 	}
 
-	fclose(f);
-
-	if (!from_lib)
-		fclose(dest);
+	FreeSections(pCtx);
 }
 
-char* trimwhitespace(char* str)
+static	char* trimwhitespace(char* str)
 {
 	char* end;
 
@@ -915,20 +955,13 @@ char* trimwhitespace(char* str)
 	return &end[1];
 }
 
-void parse_lib(const char* path, const char* dest_path)
+static	void	ParseLibStream(SMipsDis* pCtx, FILE* f)
 {
-	FILE* f;
 	ULONG	id;
 
-	if ((f = fopen(path, "rb")) == NULL)
-		Error("File \"%s\" not found", path);
-
-	if ((dest = fopen(dest_path, "wb")) == NULL)
-		Error("File \"%s\" not found", dest_path);
-
 	id = fgetll(f);
 	if (id != 0x0142494C && id != 0x0242494C)
-		Error("Not an LIB-file");
+		Error(pCtx, MD_ERR_FORMAT, "Not an LIB-file");
 
 	switch (id)
 	{
@@ -940,7 +973,6 @@ void parse_lib(const char* path, const char* dest_path)
 		unsigned int offset, base_off = 4;
 		unsigned int size;
 		char* name_end;
-		unsigned char* tmp;
 
 		while (1)
 		{
@@ -960,21 +992,9 @@ void parse_lib(const char* path, const char* dest_path)
 			fread(&offset, 1, 4, f);
 			fread(&size, 1, 4, f);
 
-			tmp = (unsigned char*)malloc(size - offset);
 			fseek(f, offset + base_off, SEEK_SET);
-			fread(tmp, 1, size - offset, f);
-
-			FILE* w = fopen(name, "wb");
-			fwrite(tmp, 1, size - offset, w);
-			fflush(dest);
-			fclose(w);
-
-			free(tmp);
-
-			parse_obj(name, NULL, 1);
-			remove(name);
-			fwrite("\n\n", 1, 2, dest);
-			fflush(dest);
+			ParseObjStream(pCtx, f, name);
+			Write(pCtx, "\n\n", 2);
 
 			base_off += size;
 			fseek(f, base_off, SEEK_SET);
@@ -1010,27 +1030,16 @@ void parse_lib(const char* path, const char* dest_path)
 			name_len += 1;
 
 			fread(name, 1, name_len, f); info_len -= name_len;
+			name[name_len] = 0;
 			//printf("%s:\n", name);
 
 			fread(&items_count, 1, 1, f); info_len -= 1;
 
 			long pos = ftell(f);
 
-			unsigned char* tmp = (unsigned char*)malloc(data_size);
 			fseek(f, data_offset, SEEK_SET);
-			fread(tmp, 1, data_size, f);
-
-			FILE* w = fopen(name, "wb");
-			fwrite(tmp, 1, data_size, w);
-			fflush(dest);
-			fclose(w);
-
-			free(tmp);
-
-			parse_obj(name, NULL, 1);
-			remove(name);
-			fwrite("\n\n", 1, 2, dest);
-			fflush(dest);
+			ParseObjStream(pCtx, f, name);
+			Write(pCtx, "\n\n", 2);
 
 			fseek(f, pos, SEEK_SET);
 
@@ -1052,119 +1061,144 @@ void parse_lib(const char* path, const char* dest_path)
 		}
 	} break;
 	}
+}
 
-	fclose(f);
-	fclose(dest);
+SMipsDis* MipsDis_Create(MipsDisSink pSink, void* pUser)
+{
+	SMipsDis* pCtx;
+
+	if ((pCtx = calloc(1, sizeof(SMipsDis))) == NULL)
+		return NULL;
+
+	pCtx->pSink = pSink;
+	pCtx->pUser = pUser;
+	pCtx->pc2dreg = psyq_c2dreg;
+	pCtx->pc2creg = psyq_c2creg;
+	pCtx->iSymbolNumber = 1000000;
+
+	return pCtx;
 }
 
-int	main(int argc, char* argv[])
+void	MipsDis_Free(SMipsDis* pCtx)
 {
-	int		argn = 1;
+	if (pCtx)
+	{
+		FreeSections(pCtx);
+		free(pCtx);
+	}
+}
 
-	if (argc <= 1)
-		PrintUsage();
+void	MipsDis_SetAltGTE(SMipsDis* pCtx, int oAltGTE)
+{
+	pCtx->OPT_ALTGTE = oAltGTE;
+	pCtx->pc2dreg = oAltGTE ? cw_c2dreg : psyq_c2dreg;
+	pCtx->pc2creg = oAltGTE ? cw_c2creg : psyq_c2creg;
+}
 
-	while (argn < argc && argv[argn][0] == '-')
+const char* MipsDis_GetError(const SMipsDis* pCtx)
+{
+	return pCtx->sError;
+}
+
+int	MipsDis_ParseObj(SMipsDis* pCtx, const char* path)
+{
+	FILE* f;
+	int		res;
+	const char* pp = strrchr(path, '/');
+	const char* pp2 = strrchr(path, '\\');
+
+	pCtx->sError[0] = 0;
+
+	if ((f = fopen(path, "rb")) == NULL)
 	{
-		switch (argv[argn][1])
-		{
-		case	'a':
-			pc2creg = cw_c2creg;
-			pc2dreg = cw_c2dreg;
-			OPT_ALTGTE = 1;
-			break;
-		default:
-			Error("Unknown option '%c'", argv[argn][1]);
-			break;
-		}
-		argn += 1;
+		snprintf(pCtx->sError, sizeof(pCtx->sError), "File \"%s\" not found", path);
+		return MD_ERR_OPEN;
+	}
+
+	if ((res = setjmp(pCtx->ErrorJump)) == 0)
+	{
+		ParseObjStream(pCtx, f, pp ? &pp[1] : (pp2 ? &pp2[1] : path));
+	}
+	else
+	{
+		FreeSections(pCtx);
 	}
 
-	int name_len = strlen(argv[argn]);
-	char* dest_name = (char*)malloc(name_len + 4 + 1);
-	strncpy(dest_name, argv[argn], name_len);
-	dest_name[name_len + 0] = '.';
-	dest_name[name_len + 1] = 'T';
-	dest_name[name_len + 2] = 'X';
-	dest_name[name_len + 3] = 'T';
-	dest_name[name_len + 4] = 0;
+	fclose(f);
+
+	return res;
+}
+
+int	MipsDis_ParseLib(SMipsDis* pCtx, const char* path)
+{
+	FILE* f;
+	int		res;
+
+	pCtx->sError[0] = 0;
+
+	if ((f = fopen(path, "rb")) == NULL)
+	{
+		snprintf(pCtx->sError, sizeof(pCtx->sError), "File \"%s\" not found", path);
+		return MD_ERR_OPEN;
+	}
 
-	if (strstr(argv[argn], ".OBJ") || strstr(argv[argn], ".obj"))
-		parse_obj(argv[argn], dest_name, 0);
-	else if (strstr(argv[argn], ".LIB") || strstr(argv[argn], ".lib"))
-		parse_lib(argv[argn], dest_name);
+	if ((res = setjmp(pCtx->ErrorJump)) == 0)
+	{
+		ParseLibStream(pCtx, f);
+	}
+	else
+	{
+		FreeSections(pCtx);
+	}
 
-	free(dest_name);
+	fclose(f);
 
-	return EXIT_SUCCESS;
+	return res;
 }
 
-unsigned char getB0(unsigned int dw)
+static	unsigned char getB0(unsigned int dw)
 {
 	return (dw >> 24) & 0xFF;
 }
 
-unsigned char getB1(unsigned int dw)
+static	unsigned char getB1(unsigned int dw)
 {
 	return (dw >> 16) & 0xFF;
 }
 
-unsigned char getB2(unsigned int dw)
+static	unsigned char getB2(unsigned int dw)
 {
 	return (dw >> 8) & 0xFF;
 }
 
-unsigned char getB3(unsigned int dw)
+static	unsigned char getB3(unsigned int dw)
 {
 	return (dw >> 0) & 0xFF;
 }
 
-void printWordAndUWordMasked(unsigned int dw)
-{
-	unsigned char b1 = getB1(dw);
-	unsigned char b0 = getB0(dw);
-
-	sprintf(ttmp, "?? ?? %02X %02X ", b1, b0);
-
-	fwrite(ttmp, 1, strlen(ttmp), dest);
-	fflush(dest);
-}
-
-void printWord(unsigned int dw)
+static	void printWord(SMipsDis* pCtx, unsigned int dw)
 {
 	unsigned char b1 = getB1(dw);
 	unsigned char b0 = getB0(dw);
 
-	sprintf(ttmp, "%02X %02X ", b1, b0);
-
-	fwrite(ttmp, 1, strlen(ttmp), dest);
-	fflush(dest);
+	Print(pCtx, "%02X %02X ", b1, b0);
 }
 
-void printDword(unsigned int dw)
+static	void printDword(SMipsDis* pCtx, unsigned int dw)
 {
 	unsigned char b0 = getB3(dw);
 	unsigned char b1 = getB2(dw);
 	unsigned char b2 = getB1(dw);
 	unsigned char b3 = getB0(dw);
 
-	sprintf(ttmp, "%02X %02X %02X %02X ", b0, b1, b2, b3);
-
-	fwrite(ttmp, 1, strlen(ttmp), dest);
-	fflush(dest);
-}
-
-void	DumpLong(ULONG data)
-{
-	printDword(data);
-	//printf("DW\t$%08X", data);
+	Print(pCtx, "%02X %02X %02X %02X ", b0, b1, b2, b3);
 }
 
-SSymbol* GetSymbol(ULONG iID)
+static	SSymbol* GetSymbol(SMipsDis* pCtx, ULONG iID)
 {
 	SSection* pSect;
 
-	pSect = pSections;
+	pSect = pCtx->pSections;
 	while (pSect)
 	{
 		SSymbol* pSym;
@@ -1184,127 +1218,155 @@ SSymbol* GetSymbol(ULONG iID)
 	return NULL;
 }
 
-char* GetSymbolName(SSection* pSect, ULONG iOffset, SLONG iRel)
+static	void WordPatch(SMipsDis* pCtx, SPatch* pPatch, ULONG data, int size)
 {
-	static	char	temp[256];
-	SSymbol* pSym;
-
-	iOffset += iRel;
-
-	pSym = pSect->pSymbols;
-	while (pSym)
+	if (pPatch)
 	{
-		if (pSym->iOffset == iOffset)
+		for (int i = 0; i < size; ++i)
 		{
-			sprintf(temp, "%s", pSym->sName);
-			return temp;
+			Write(pCtx, "?? ", 3);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < size; ++i)
+		{
+			Print(pCtx, "%02X ", data & 0xFF);
+			data >>= 8;
 		}
-		pSym = pSym->pNext;
 	}
-
-	sprintf(temp, "*%+d", iRel);
-	return temp;
 }
 
-char* FormatExpr(SExpression* pExpr, char* pBuf)
+//	Names the symbol a jal is relocated to, so the callee can be labelled after a match
+static	void	DumpCallTarget(SMipsDis* pCtx, SPatch* pPatch)
 {
-	switch (pExpr->Operator)
-	{
-	case	OP_CONSTANT:
-		sprintf(pBuf, "$%X", pExpr->iValue);
-		break;
-	case	OP_SECTBASE:
-		sprintf(pBuf, "sectbase(%s)", GetSection(pExpr->iValue)->sName);
-		break;
-	case	OP_SECTEND:
-		sprintf(pBuf, "sectend(%s)", GetSection(pExpr->iValue)->sName);
-		break;
-	case	OP_SECTSIZE:
-		sprintf(pBuf, "sectsize(%s)", GetSection(pExpr->iValue)->sName);
-		break;
-	case	OP_ADDROFSYMBOL:
-		sprintf(pBuf, "%s", GetSymbol(pExpr->iValue)->sName);
-		break;
-	case	OP_ADD:
-		sprintf(pBuf, "(");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pLeft, pBuf);
-		sprintf(pBuf, "+");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pRight, pBuf);
-		sprintf(pBuf, ")");
-		pBuf += 1;
-		break;
-	case	OP_MUL:
-		pBuf = FormatExpr(pExpr->pLeft, pBuf);
-		sprintf(pBuf, "*");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pRight, pBuf);
-		break;
-	case OP_DIV:
-		pBuf = FormatExpr(pExpr->pLeft, pBuf);
-		sprintf(pBuf, "/");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pRight, pBuf);
-		break;
-	case	OP_SUB:
-		sprintf(pBuf, "(");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pLeft, pBuf);
-		sprintf(pBuf, "-");
-		pBuf += 1;
-		pBuf = FormatExpr(pExpr->pRight, pBuf);
-		sprintf(pBuf, ")");
-		pBuf += 1;
-		break;
-	}
+	SSymbol* pSym;
+
+	if (pPatch == NULL || pPatch->pExpr->Operator != OP_ADDROFSYMBOL)
+		return;
 
-	return pBuf + strlen(pBuf);
+	if ((pSym = GetSymbol(pCtx, pPatch->pExpr->iValue)) != NULL)
+		Print(pCtx, "\n@jal %s\n", pSym->sName);
 }
 
-void WordPatch(SPatch* pPatch, ULONG data, int size)
+static	const char* sPatchTypes[] =
 {
-	if (pPatch)
+	"WORD", "LONG", "LO", "HI", "GP", "FP"
+};
+
+//	Names the symbol and addend a relocated 16 bit immediate refers to
+//	(HI/LO pairs, GP relative, lui/ori), so globals can be labelled after a match
+static	void	DumpReloc(SMipsDis* pCtx, SPatch* pPatch)
+{
+	SExpression* pExpr;
+	SExpression* pConst = NULL;
+	SSymbol* pSym;
+	SLONG	iAddend = 0;
+
+	if (pPatch == NULL || pPatch->Type == PATCH_LONG || pPatch->Type == PATCH_MIPSFP)
+		return;
+
+	pExpr = pPatch->pExpr;
+	if (pExpr->Operator == OP_ADD || pExpr->Operator == OP_SUB)
 	{
-		for (int i = 0; i < size; ++i)
+		if (pExpr->pLeft->Operator == OP_ADDROFSYMBOL && pExpr->pRight->Operator == OP_CONSTANT)
 		{
-			fwrite("?? ", 1, 3, dest);
-			fflush(dest);
+			pConst = pExpr->pRight;
+			pExpr = pExpr->pLeft;
 		}
-	}
-	else
-	{
-		for (int i = 0; i < size; ++i)
+		else if (pExpr->Operator == OP_ADD && pExpr->pRight->Operator == OP_ADDROFSYMBOL
+			&& pExpr->pLeft->Operator == OP_CONSTANT)
 		{
-			sprintf(ttmp, "%02X ", data & 0xFF);
-			fwrite(ttmp, 1, strlen(ttmp), dest);
-			fflush(dest);
-			data >>= 8;
+			pConst = pExpr->pLeft;
+			pExpr = pExpr->pRight;
 		}
+		else
+			return;
+
+		iAddend = pPatch->pExpr->Operator == OP_SUB ? -pConst->iValue : pConst->iValue;
 	}
+
+	if (pExpr->Operator != OP_ADDROFSYMBOL)
+		return;
+
+	if ((pSym = GetSymbol(pCtx, pExpr->iValue)) != NULL)
+		Print(pCtx, "\n@rel %s %s %ld\n", sPatchTypes[pPatch->Type], pSym->sName, iAddend);
 }
 
-void	Disassemble(SSection* pSect)
+//	Opcode properties, indexed by the top 6 bits of an instruction
+#define	OPF_BRANCH	0x01	//	16 bit pc relative target
+#define	OPF_REGIMM	0x02	//	branch when rt < 4 (bltz, bgez, bltzal, bgezal)
+#define	OPF_JUMP	0x04	//	26 bit target, relocated
+#define	OPF_IMM16	0x08	//	16 bit immediate, relocated
+
+#define	OPF_X4(f)	f, f, f, f
+#define	OPF_X8(f)	OPF_X4(f), OPF_X4(f)
+
+static	const UBYTE	OpcodeFlags[64] =
+{
+	0, OPF_REGIMM, OPF_JUMP, OPF_JUMP, OPF_X4(OPF_BRANCH),	//	special, regimm, j, jal, beq..bgtz
+	OPF_X8(OPF_IMM16),										//	addi..lui
+	OPF_X4(0), OPF_X4(OPF_BRANCH),							//	cop0..cop3, beql..bgtzl
+	OPF_X8(0),
+	OPF_X8(OPF_IMM16), OPF_X8(OPF_IMM16),					//	loads, stores
+	OPF_X8(OPF_IMM16), OPF_X8(OPF_IMM16),					//	lwc, swc
+};
+
+static	ULONG	GetLong(SSection* pSect, ULONG index)
+{
+	return pSect->pData[index]
+		| (pSect->pData[index + 1] << 8)
+		| (pSect->pData[index + 2] << 16)
+		| ((ULONG)pSect->pData[index + 3] << 24);
+}
+
+//	Marks the target of every pc relative branch of .text in a bit per word,
+//	these get a loc_ label unless a symbol is already there
+static	UBYTE* BranchTargets(SMipsDis* pCtx, SSection* pSect)
+{
+	UBYTE* pTargets;
+	ULONG	count = pSect->iSize / 4;
+	ULONG	index;
+
+	pTargets = Alloc(pCtx, count / 8 + 1);
+	memset(pTargets, 0, count / 8 + 1);
+
+	if (strcmp(pSect->sName, ".text") != 0)
+		return pTargets;
+
+	for (index = 0; index < count * 4; index += 4)
+	{
+		ULONG	data = GetLong(pSect, index);
+		UBYTE	flags = OpcodeFlags[data >> 26];
+		SLONG	target;
+
+		if (!(flags & OPF_BRANCH) && !((flags & OPF_REGIMM) && ((data >> 16) & 0x1F) < 4))
+			continue;
+
+		target = ((SLONG)(SWORD)data << 2) + index + 4;
+		if (target >= 0 && (ULONG)target < count * 4)
+			pTargets[target / 32] |= 1 << ((target / 4) & 7);
+	}
+
+	return pTargets;
+}
+
+static	void	Disassemble(SMipsDis* pCtx, SSection* pSect)
 {
 	ULONG	index = 0;
 	ULONG	size;
-	ULONG	PC = 0;
 	SSymbol* pSym;
+	UBYTE* pTargets;
 	int has_name = 0;
 
-	pSym = pSect->pSymbols;
-	while (pSym)
-	{
-		pSym = pSym->pNext;
-	}
-
 	size = pSect->iSize;
+	pTargets = BranchTargets(pCtx, pSect);
 
 	while (size)
 	{
 		ULONG	data;
-		ULONG	code1,
-			code2;
+		UBYTE	flags;
+		int		labelled = 0;
 		SPatch* pPatch;
 
 		pSym = pSect->pSymbols;
@@ -1312,19 +1374,22 @@ void	Disassemble(SSection* pSect)
 		{
 			if (pSym->iOffset == index)
 			{
-				sprintf(ttmp, "\n%s:\n", pSym->sName);
-				fwrite(ttmp, 1, strlen(ttmp), dest);
-				fflush(dest);
+				Print(pCtx, "\n%s:\n", pSym->sName);
 				has_name = 1;
+				labelled = 1;
 			}
 			pSym = pSym->pNext;
 		}
 
+		if (!labelled && (pTargets[index / 32] & (1 << ((index / 4) & 7))))
+		{
+			Print(pCtx, "\nloc_%lX:\n", index);
+			has_name = 1;
+		}
+
 		if (!has_name)
 		{
-			sprintf(ttmp, "\nloc_%X:\n", index);
-			fwrite(ttmp, 1, strlen(ttmp), dest);
-			fflush(dest);
+			Print(pCtx, "\nloc_%lX:\n", index);
 			has_name = 1;
 		}
 
@@ -1338,204 +1403,89 @@ void	Disassemble(SSection* pSect)
 			pPatch = pPatch->pNext;
 		}
 
-		data = pSect->pData[index++];
-		data |= pSect->pData[index++] << 8;
-		data |= pSect->pData[index++] << 16;
-		data |= pSect->pData[index++] << 24;
+		data = GetLong(pSect, index);
+		flags = OpcodeFlags[data >> 26];
+		index += 4;
 		size -= 4;
 
-		PC += 4;
-
-		code1 = (data >> 29) & 0x7;
-		code2 = (data >> 26) & 0x7;
-
-		switch (code1)
+		if (flags & OPF_JUMP)
 		{
-		case 0:
-			switch (code2)
-			{
-			case 0:
-			case 1:
-			case 4:
-			case 5:
-			case 6:
-			case 7:
-				printDword(data);
-				break;
-			case 2:
-			case 3:
-				WordPatch(pPatch, ((data & 0x03FFFFFF) << 2), 3);
-				sprintf(ttmp, "%02X ", getB0(data));
-				fwrite(ttmp, 1, strlen(ttmp), dest);
-				fflush(dest);
-				break;
-			}
-			break;
-		case 1:
-		case 4:
-		case 5:
-		case 6:
-		case 7:
-			WordPatch(pPatch, (UWORD)data, 2);
-			printWord(data);
-			break;
-		case 2:
-			printDword(data);
-			break;
-		default:
-			DumpLong(data);
-			break;
-		}
-	}
-}
-
-void	BSSDump(SSection* pSect)
-{
-	SSymbol** ppSym;
-	SSymbol* pSym;
-	int	oSwapped = 1;
-
-	while (oSwapped)
-	{
+			WordPatch(pCtx, pPatch, ((data & 0x03FFFFFF) << 2), 3);
+			Print(pCtx, "%02X ", getB0(data));
 
-		ppSym = &pSect->pSymbols;
-		oSwapped = 0;
-		while ((*ppSym) && (*ppSym)->pNext)
-		{
-			if ((*ppSym)->iOffset > (*ppSym)->pNext->iOffset)
-			{
-				SSymbol* t;
-
-				t = (*ppSym);
-				*ppSym = t->pNext;
-				t->pNext = t;
-
-				oSwapped = 1;
-			}
-
-			ppSym = &(*ppSym)->pNext;
+			if (data >> 26 == 3)
+				DumpCallTarget(pCtx, pPatch);
 		}
-	}
-
-	pSym = pSect->pSymbols;
-	while (pSym)
-	{
-		int	size;
-
-		if (pSym->pNext)
+		else if (flags & OPF_IMM16)
 		{
-			size = pSym->pNext->iOffset - pSym->iOffset;
+			WordPatch(pCtx, pPatch, (UWORD)data, 2);
+			printWord(pCtx, data);
+			DumpReloc(pCtx, pPatch);
 		}
 		else
 		{
-			size = pSect->iSize - pSym->iOffset;
+			printDword(pCtx, data);
 		}
-		pSym = pSym->pNext;
 	}
+
+	free(pTargets);
 }
 
-void	FixRelativeJumps(SSection* pSect)
+//	Number of bytes a patch changes
+static	int		PatchSize(SPatch* pPatch)
 {
-	ULONG	index = 0;
-	ULONG	size;
-
-	if (pSect->pData == NULL)
-		return;
-
-	size = pSect->iSize;
-
-	while (size)
+	switch (pPatch->Type)
 	{
-		ULONG	data;
-		ULONG	code1,
-			code2;
-		int		found;
-
-		found = 0;
+	case	PATCH_LONG:
+	case	PATCH_MIPSFP:
+		return 4;
+	default:
+		return 2;
+	}
+}
 
-		data = pSect->pData[index++];
-		data |= pSect->pData[index++] << 8;
-		data |= pSect->pData[index++] << 16;
-		data |= pSect->pData[index++] << 24;
-		size -= 4;
+static	void	ByteDump(SMipsDis* pCtx, SSection* pSect)
+{
+	ULONG	index;
+	int		column = 0;
 
-		code1 = (data >> 29) & 0x7;
-		code2 = (data >> 26) & 0x7;
+	for (index = 0; index < pSect->iSize; ++index)
+	{
+		SSymbol* pSym;
+		SPatch* pPatch;
 
-		switch (code1)
+		pSym = pSect->pSymbols;
+		while (pSym)
 		{
-		case 0:
-			switch (code2)
-			{
-			case 1:
-				//	REGIMM function
-			{
-				ULONG	code3,
-					code4;
-
-				code3 = (data >> 19) & 0x3;
-				code4 = (data >> 16) & 0x7;
-
-				switch (code3)
-				{
-				case 0:
-					switch (code4)
-					{
-					case 0:
-					case 1:
-					case 2:
-					case 3:
-						found = 1;
-						break;
-					}
-					break;
-				}
-				break;
-			}
-			case 4:
-			case 5:
-			case 6:
-			case 7:
-				found = 1;
-				break;
-			}
-			break;
-		case 2:
-			switch (code2)
+			if (pSym->iOffset == index)
 			{
-			case 4:
-			case 5:
-			case 6:
-			case 7:
-				found = 1;
-				break;
+				Print(pCtx, "\n%s:\n", pSym->sName);
+				column = 0;
 			}
-			break;
+			pSym = pSym->pNext;
 		}
 
-		if (found)
+		pPatch = pSect->pPatches;
+		while (pPatch)
 		{
-			SSymbol* pSym;
-			int	offset = (SWORD)data;
-			offset = (offset << 2) + index;
-
-			pSym = pSect->pSymbols;
-			while (pSym)
+			if ((index >= pPatch->iOffset) && (index < pPatch->iOffset + PatchSize(pPatch)))
 			{
-				if (pSym->iOffset == offset)
-					break;
-				pSym = pSym->pNext;
+				break;
 			}
+			pPatch = pPatch->pNext;
+		}
 
-			if (pSym == NULL)
-			{
-				pSym = CreateSymbol(pSect, SYM_LOCAL);
-				pSym->iNumber = iSymbolNumber;
-				pSym->iOffset = offset;
-				sprintf(pSym->sName, "%s_%X", "loc", pSym->iOffset);
-				iSymbolNumber += 1;
-			}
+		if (pPatch)
+			Write(pCtx, "?? ", 3);
+		else
+			Print(pCtx, "%02X ", pSect->pData[index]);
+
+		if (++column == 16)
+		{
+			Write(pCtx, "\n", 1);
+			column = 0;
 		}
 	}
+	if (column)
+		Write(pCtx, "\n", 1);
 }
-
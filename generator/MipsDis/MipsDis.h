@@ -0,0 +1,35 @@
+#ifndef MIPSDIS_H
+#define MIPSDIS_H 1
+
+#include	<stddef.h>
+
+//	Reentrant interface to the MipsDis signature generator.
+//	Every parser state lives in an SMipsDis context, so separate contexts
+//	can be used from separate threads. Nothing here calls exit().
+
+typedef	enum
+{
+	MD_OK = 0,
+	MD_ERR_OPEN,
+	MD_ERR_FORMAT,
+	MD_ERR_UNSUPPORTED,
+	MD_ERR_MEMORY,
+}	EMipsDisError;
+
+//	Receives the generated text. pText is not zero terminated.
+typedef	void	(*MipsDisSink)(void* pUser, const char* pText, size_t iLen);
+
+typedef	struct	_SMipsDis	SMipsDis;
+
+SMipsDis*	MipsDis_Create(MipsDisSink pSink, void* pUser);
+void	MipsDis_Free(SMipsDis* pCtx);
+
+void	MipsDis_SetAltGTE(SMipsDis* pCtx, int oAltGTE);
+
+//	Both return MD_OK or an error code, see MipsDis_GetError() for details.
+int	MipsDis_ParseObj(SMipsDis* pCtx, const char* path);
+int	MipsDis_ParseLib(SMipsDis* pCtx, const char* path);
+
+const char*	MipsDis_GetError(const SMipsDis* pCtx);
+
+#endif
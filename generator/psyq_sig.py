@@ -6,6 +6,10 @@ import json
 OBJ_NAME_R = re.compile(r'^==(\w+\.OBJ)==$', re.IGNORECASE)
 FUNC_NAME_R = re.compile(r'^(\w+):$')
 FUNC_SIG_R = re.compile(r'^((?:[0-9A-F?]{2} )+)$')
+JAL_R = re.compile(r'^@jal (\w+)$')
+DATA_R = re.compile(r'^\$DATA_(\w+):$')
+REL_R = re.compile(r'^@rel (\w+) (\w+) (-?\d+)$')
+LUI = 0x0F
 
 
 def main(path):
@@ -30,8 +34,13 @@ def main(path):
                 obj = {
                     'name': m_name.group(1),
                     'sig': '',
-                    'labels': list()
+                    'labels': list(),
+                    'calls': list(),
+                    'relocs': list(),
+                    'data': list()
                 }
+                block = obj
+                his = dict()
                 added = False
 
                 i += 1
@@ -43,12 +52,61 @@ def main(path):
                         i += 1
                         continue
 
+                    m_data = DATA_R.match(line)
+
+                    if m_data is not None:
+                        # data sections come after all code, bytes and labels go to their own block
+                        block = {
+                            'section': m_data.group(1),
+                            'sig': '',
+                            'labels': list()
+                        }
+                        obj['data'].append(block)
+
+                        i += 1
+                        continue
+
                     m_func_name = FUNC_NAME_R.match(line)
 
                     if m_func_name is not None:
-                        obj['labels'].append({
+                        block['labels'].append({
                             'name': m_func_name.group(1),
-                            'offset': len(obj['sig']) // 3  # 'HH '
+                            'offset': len(block['sig']) // 3  # 'HH '
+                        })
+
+                        i += 1
+                        continue
+
+                    m_rel = REL_R.match(line)
+
+                    if m_rel is not None:
+                        # the relocated word was the last one written, LO and ori point back to their HI or lui
+                        rel = {
+                            'offset': len(obj['sig']) // 3 - 4,
+                            'type': m_rel.group(1),
+                            'name': m_rel.group(2),
+                            'addend': int(m_rel.group(3))
+                        }
+                        key = (rel['name'], rel['addend'])
+                        opcode = int(obj['sig'][-3:-1], 16) >> 2
+
+                        if rel['type'] == 'HI' or (rel['type'] == 'WORD' and opcode == LUI):
+                            his[key] = rel['offset']
+                        elif rel['type'] in ('LO', 'WORD') and key in his:
+                            rel['hi'] = his[key]
+
+                        obj['relocs'].append(rel)
+
+                        i += 1
+                        continue
+
+                    m_jal = JAL_R.match(line)
+
+                    if m_jal is not None:
+                        # the jal word was the last one written
+                        obj['calls'].append({
+                            'name': m_jal.group(1),
+                            'offset': len(obj['sig']) // 3 - 4
                         })
 
                         i += 1
@@ -56,7 +114,7 @@ def main(path):
                         m_func_sig = FUNC_SIG_R.match(line)
 
                         if m_func_sig is not None:
-                            obj['sig'] += m_func_sig.group(1)
+                            block['sig'] += m_func_sig.group(1)
                             i += 1
                         else:
                             objs.append(obj)
@@ -0,0 +1,111 @@
+import struct
+
+
+WORDS_PER_MISMATCH = 8
+
+
+def lane_bits(count):
+    # lowest bit of every 32-bit lane
+    return int.from_bytes(b'\x01\x00\x00\x00' * count, 'little')
+
+
+def mismatched_words(diff, lanes):
+    # folds every 32-bit lane of diff into its lowest bit, all lanes at once
+    diff |= diff >> 16
+    diff |= diff >> 8
+    diff |= diff >> 4
+    diff |= diff >> 2
+    diff |= diff >> 1
+
+    return diff & lanes
+
+
+def build_approx_index(index, k):
+    # pigeonhole: with at most k bad words, one of any k + 1 fixed words matches
+    # exactly, so the k + 1 least common ones become anchors.
+    # Short signatures would match noise with k bad words, they get fewer.
+    freq = index['freq']
+    words = dict()
+
+    for group in index['groups']:
+        count = group['size'] // 4
+        value = group['value'].to_bytes(group['size'], 'little')
+        mask = group['mask'].to_bytes(group['size'], 'little')
+        fixed = [(i * 4, struct.unpack_from('<I', value, i * 4)[0]) for i in range(count)
+                 if mask[i * 4:i * 4 + 4] == b'\xFF\xFF\xFF\xFF']
+
+        group['lanes'] = lane_bits(count)
+        group['k'] = min(k, len(fixed) // WORDS_PER_MISMATCH)
+
+        for anchor, word in sorted(fixed, key=lambda x: (freq[x[1]], x[0]))[:group['k'] + 1]:
+            words.setdefault(word, list()).append((group, anchor))
+
+    return {'words': words, 'k': k}
+
+
+def patch_entries(view, offset, group, bad):
+    # patches.json style entries turning the signature into the found bytes
+    value = group['value'].to_bytes(group['size'], 'little')
+    mask = group['mask'].to_bytes(group['size'], 'little')
+    entries = list()
+
+    for pos in bad:
+        diff = [i for i in range(pos, pos + 4) if mask[i] and value[i] != view[offset + i]]
+        first, last = diff[0], diff[-1] + 1
+
+        entries.append({
+            'pos': first,
+            'data': '~' + ''.join('%02X ' % view[offset + i] for i in range(first, last)),
+            'check': ''.join('%02X ' % value[i] if mask[i] else '?? ' for i in range(first, last))
+        })
+
+    return entries
+
+
+def scan_approx(data, aindex, start=0, end=None):
+    view = memoryview(data)
+    words = aindex['words']
+    seen = set()
+    hits = list()
+
+    if end is None:
+        end = len(view)
+
+    start &= ~3
+    end = start + ((end - start) & ~3)
+
+    for n, (word,) in enumerate(struct.iter_unpack('<I', view[start:end])):
+        candidates = words.get(word)
+
+        if candidates is None:
+            continue
+
+        pos = start + n * 4
+
+        for group, anchor in candidates:
+            offset = pos - anchor
+            key = (offset, id(group))
+
+            if offset < 0 or offset + group['size'] > len(view) or key in seen:
+                continue
+
+            seen.add(key)
+            diff = (int.from_bytes(view[offset:offset + group['size']], 'little') ^ group['value']) & group['mask']
+            bad_lanes = mismatched_words(diff, group['lanes']) if diff else 0
+            count = bin(bad_lanes).count('1')
+
+            if count > group['k']:
+                continue
+
+            bad = [i // 8 for i, bit in enumerate(bin(bad_lanes)[:1:-1]) if bit == '1']
+            patches = patch_entries(view, offset, group, bad) if bad else list()
+
+            for sig in group['sigs']:
+                hits.append({
+                    'offset': offset,
+                    'sig': sig,
+                    'mismatched': 4 * count,
+                    'patches': patches
+                })
+
+    return hits
@@ -0,0 +1,102 @@
+import sys
+import json
+import argparse
+
+import psyq_exe
+import psyq_scan
+
+
+CHUNK_SIZE = 0x40000
+
+
+def chunk_tasks(paths, manifest=None):
+    # largest files first: their chunks spread over all workers while small files fill the gaps.
+    # Only the text image of an EXE is cut into chunks, its header is never read again
+    ranges = [psyq_exe.read_layout(path, manifest)[1][0] for path in paths]
+    tasks = list()
+
+    for n in sorted(range(len(paths)), key=lambda n: (ranges[n][0] - ranges[n][1], n)):
+        first, last = ranges[n]
+
+        for start in range(first, max(last, first + 1), CHUNK_SIZE):
+            tasks.append((n, paths[n], start, min(last, start + CHUNK_SIZE), last))
+
+    return tasks
+
+
+def scan_chunk(task):
+    # hits anchored in [start, end), read with max_size bytes around (up to the end of
+    # the image, last) so whole signatures fit
+    n, path, start, end, last = task
+    # a whole number of words, scan() must see the words of the file at their own phase
+    overlap = (psyq_scan.worker['index']['max_size'] + 3) & ~3
+    window = max(0, start - overlap)
+
+    with open(path, 'rb') as f:
+        f.seek(window)
+        data = f.read(min(last, end + overlap) - window)
+
+    hits = psyq_scan.scan(data, psyq_scan.worker['index'], start - window, end - window)
+
+    return n, [(window + hit['offset'], hit['sig']['id'], hit['verified']) for hit in psyq_scan.complete(hits, data)]
+
+
+def finish_file(n, path, hits):
+    worker = psyq_scan.worker
+
+    with open(path, 'rb') as f:
+        data, base, _ = psyq_exe.load_input(f.read(), path, worker['manifest'])
+
+    hits = [{'offset': offset, 'sig': worker['sigs'][sig_id], 'verified': verified} for offset, sig_id, verified in sorted(hits)]
+    hits = psyq_scan.keep_near(hits, worker['index'], len(data))
+
+    return {'file': path, 'results': psyq_scan.finish(hits, data, base)}
+
+
+def write_item(item):
+    json.dump(item, sys.stdout)
+    sys.stdout.write('\n')
+    sys.stdout.flush()
+
+
+def main(paths, db_path=psyq_scan.DB_PATH, versions=None, jobs=None, meta_path=None, manifest_path=None):
+    tasks = chunk_tasks(paths, psyq_exe.load_manifest(manifest_path))
+    pending = [0] * len(paths)
+    raw = [list() for _ in paths]
+    finals = dict()
+    done = 0
+
+    for n, _, _, _, _ in tasks:
+        pending[n] += 1
+
+    with psyq_scan.worker_pool(jobs, db_path, versions, meta_path, manifest_path) as pool:
+        # idle workers take the next chunk from the shared queue, whatever file it belongs to
+        for n, hits in pool.imap_unordered(scan_chunk, tasks):
+            raw[n].extend(hits)
+            pending[n] -= 1
+
+            if pending[n] == 0:
+                finals[n] = pool.apply_async(finish_file, (n, paths[n], raw[n]))
+                raw[n] = None
+
+            # files are written in the given order, as soon as they and all before are done
+            while done in finals and finals[done].ready():
+                write_item(finals.pop(done).get())
+                done += 1
+
+        while done < len(paths):
+            write_item(finals.pop(done).get())
+            done += 1
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Scans many executables and overlays with all cores')
+    parser.add_argument('paths', nargs='+')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-j', '--jobs', type=int, help='number of worker processes')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    args = parser.parse_args()
+
+    main(args.paths, args.db, args.ver, args.jobs, args.index, args.manifest)
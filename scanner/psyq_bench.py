@@ -0,0 +1,150 @@
+import time
+import random
+import struct
+import argparse
+
+import psyq_db
+import psyq_scan
+import psyq_approx
+
+
+BASE = 0x80010000
+HEADER_SIZE = 0x800
+EXE_MAGIC = b'PS-X EXE'
+RAM_END = 0x80200000
+MODES = ('exact', 'prefix', 'full', 'approx')
+JAL = 0x03
+
+# filler between OBJs: addiu, lw, sw, or, sll with random registers and immediates
+NOISE_OPS = (0x24000000, 0x8C000000, 0xAC000000, 0x00000025, 0x00000000)
+
+
+def fill_word(rng, value, mask):
+    # a plausible value for a relocated word: jal targets and lui inside main RAM.
+    # Masks cover whole bytes, the fixed top byte of a jal keeps its opcode and the
+    # two high target bits (0 inside main RAM), the low 24 bits take the word index
+    if mask == 0xFF000000 and value >> 26 == JAL:
+        return value | (rng.randrange(BASE, RAM_END) >> 2 & 0x00FFFFFF)
+
+    if mask == 0xFFFF0000 and value >> 26 == 0x0F:
+        return value | (0x8001 + rng.randrange(0x1F))
+
+    return value | (rng.getrandbits(32) & ~mask & 0xFFFFFFFF)
+
+
+def make_body(rng, sig):
+    count = sig['size'] // 4
+    values = struct.unpack('<%dI' % count, sig['value'])
+    masks = struct.unpack('<%dI' % count, sig['mask'])
+
+    return struct.pack('<%dI' % count, *(fill_word(rng, v, m) for v, m in zip(values, masks)))
+
+
+def make_noise(rng, count):
+    words = list()
+
+    for _ in range(count):
+        op = rng.choice(NOISE_OPS)
+
+        if op & 0xFC000000:
+            op |= rng.getrandbits(10) << 16 | rng.getrandbits(16)
+        elif op:
+            op |= rng.getrandbits(15) << 11
+
+        words.append(op)
+
+    return struct.pack('<%dI' % count, *words)
+
+
+def make_exe(rng, sigs, count, noise):
+    # PS-X EXE of count OBJs with up to noise words between them, and its ground truth
+    body = bytearray()
+    truth = list()
+
+    for sig in rng.sample(sigs, min(count, len(sigs))):
+        body += make_noise(rng, rng.randrange(noise + 1))
+        truth.append((HEADER_SIZE + len(body), sig))
+        body += make_body(rng, sig)
+
+    header = bytearray(HEADER_SIZE)
+    header[:8] = EXE_MAGIC
+    struct.pack_into('<4I', header, 0x10, BASE, 0, BASE, len(body))
+
+    return bytes(header + body), truth
+
+
+def score(items, truth, patterns):
+    # a hit is right when it is at a true offset with the same bytes, whatever the version
+    expected = dict((BASE - HEADER_SIZE + offset, (sig['value'], sig['mask'])) for offset, sig in truth)
+    found = [item for item in items if 'obj' in item]
+    right = sum(1 for item in found
+                if expected.get(item['address']) in patterns[(item['ver'], item['lib'], item['obj'])])
+
+    return right, len(found), len(expected)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def run(mode, exes, patterns, index, aindex):
+    times = list()
+    right = found = expected = 0
+    size = 0
+
+    for data, truth in exes:
+        start = time.perf_counter()
+        items = psyq_scan.match(data, index, BASE - HEADER_SIZE, aindex=aindex)
+        times.append(time.perf_counter() - start)
+
+        r, f, e = score(items, truth, patterns)
+        right, found, expected = right + r, found + f, expected + e
+        size += len(data)
+
+    return {
+        'mode': mode,
+        'mbs': size / sum(times) / 1e6,
+        'p50': percentile(times, 50) * 1000,
+        'p90': percentile(times, 90) * 1000,
+        'p99': percentile(times, 99) * 1000,
+        'precision': right / found if found else 1.0,
+        'recall': right / expected if expected else 1.0
+    }
+
+
+def main(ver, db_path=psyq_scan.DB_PATH, exe_count=20, obj_count=300, noise=64, seed=1, modes=MODES):
+    rng = random.Random(seed)
+    sigs = psyq_scan.load_db(db_path)
+    own = [sig for sig in sigs if sig['ver'] == ver]
+
+    patterns = dict()
+    for sig in sigs:
+        patterns.setdefault((sig['ver'], sig['lib'], sig['name']), set()).add((sig['value'], sig['mask']))
+
+    exes = [make_exe(rng, own, obj_count, noise) for _ in range(exe_count)]
+
+    meta = psyq_db.build(db_path) if set(modes) & {'prefix', 'full'} else None
+
+    print('%-8s %8s %8s %8s %8s %9s %9s' % ('mode', 'MB/s', 'p50 ms', 'p90 ms', 'p99 ms', 'precision', 'recall'))
+
+    for mode in modes:
+        index = psyq_scan.build_index(sigs, meta if mode in ('prefix', 'full') else None, mode == 'full')
+        aindex = psyq_approx.build_approx_index(index, 1) if mode == 'approx' else None
+        item = run(mode, exes, patterns, index, aindex)
+
+        print('%(mode)-8s %(mbs)8.2f %(p50)8.1f %(p90)8.1f %(p99)8.1f %(precision)9.4f %(recall)9.4f' % item)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Matcher speed and accuracy on synthetic PS-X EXEs')
+    parser.add_argument('-v', '--ver', default='470', help='SDK version the executables are built from')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-n', '--count', type=int, default=20, help='number of executables')
+    parser.add_argument('-o', '--objs', type=int, default=300, help='OBJs per executable')
+    parser.add_argument('-w', '--noise', type=int, default=64, help='most noise words between two OBJs')
+    parser.add_argument('-s', '--seed', type=int, default=1)
+    parser.add_argument('-m', '--mode', action='append', choices=MODES, help='only run these modes')
+    args = parser.parse_args()
+
+    main(args.ver, args.db, args.count, args.objs, args.noise, args.seed, args.mode or MODES)
@@ -0,0 +1,154 @@
+import os
+import json
+import hashlib
+import argparse
+
+import psyq_exe
+import psyq_scan
+
+
+CACHE_PATH = os.path.join(os.path.expanduser('~'), '.cache', 'psyq_scan')
+# raised when the raw hits of an entry change meaning, older entries are rescanned
+ENTRY_FORMAT = 2
+SIG_FIELDS = ('id', 'ver', 'lib', 'name', 'size', 'fixed', 'labels', 'calls', 'relocs', 'section')
+
+
+def file_hash(path):
+    h = hashlib.sha1()
+
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(0x100000), b''):
+            h.update(chunk)
+
+    return h.hexdigest()
+
+
+def read_entry(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def write_entry(path, item):
+    # written aside and renamed, a concurrent reader never sees half an entry
+    tmp = '%s.%d' % (path, os.getpid())
+
+    with open(tmp, 'w') as w:
+        json.dump(item, w)
+
+    os.replace(tmp, path)
+
+
+def db_state(db_path, versions=None, meta_path=None, full=False):
+    # content hash of every DB file, plus the options that decide the results
+    files = [(ver, lib, path, file_hash(path)) for ver, lib, path in psyq_scan.db_files(db_path, versions)]
+    options = '%d/%s/%d' % (ENTRY_FORMAT, file_hash(meta_path) if meta_path else '-', full)
+
+    digest = hashlib.sha1(options.encode())
+    for ver, lib, _, h in files:
+        digest.update(('%s/%s/%s' % (ver, lib, h)).encode())
+
+    return files, options, digest.hexdigest()
+
+
+def short_hash(text):
+    return hashlib.sha1(text.encode()).hexdigest()[:16]
+
+
+def replace_stale(entry_path, prefix, name):
+    # an entry is stale when a newer DB state took its place under the same key,
+    # entries of other bases, versions or options stay
+    for old in os.listdir(entry_path):
+        if old.startswith(prefix) and old != name:
+            os.remove(os.path.join(entry_path, old))
+
+
+def file_hits(data, sigs, meta, full, ranges):
+    # raw hits of one DB file, with what resolving them needs from each signature;
+    # which low specificity hits are kept depends on the hits of all DB files
+    index = psyq_scan.build_index(sigs, meta, full)
+    hits = psyq_scan.complete([hit for start, end in ranges for hit in psyq_scan.scan(data, index, start, end)], data)
+    raw = list()
+
+    for hit in hits:
+        item = {'offset': hit['offset'], 'sig': dict((k, hit['sig'][k]) for k in SIG_FIELDS if k in hit['sig']),
+                'verified': hit['verified']}
+
+        if hit['sig']['id'] in index['low']:
+            item['low'] = True
+        raw.append(item)
+
+    return raw
+
+
+def match(data, db_path=psyq_scan.DB_PATH, versions=None, base=0, meta_path=None, full=False, cache_path=CACHE_PATH,
+          ranges=None):
+    # final results are kept per (binary, DB state), raw hits per (binary, DB file),
+    # so a changed DB file only rescans the binary with the signatures of that file
+    ranges = ranges or [(0, len(data))]
+    files, options, digest = db_state(db_path, versions, meta_path, full)
+    options += '/' + ','.join('%X-%X' % (start, end) for start, end in ranges)
+    entry_path = os.path.join(cache_path, hashlib.sha1(data).hexdigest())
+    final_prefix = 'results-%s-' % short_hash('%s/%s/%08X' % (','.join(versions or ['*']), options, base))
+    final_name = final_prefix + digest + '.json'
+
+    items = read_entry(os.path.join(entry_path, final_name))
+    if items is not None:
+        return items
+
+    os.makedirs(entry_path, exist_ok=True)
+    meta = psyq_scan.load_meta(meta_path)
+    hits = list()
+
+    for ver, lib, path, h in files:
+        raw_prefix = '%s-%s-%s-' % (ver, lib, short_hash(options))
+        raw_name = raw_prefix + h + '.json'
+        raw = read_entry(os.path.join(entry_path, raw_name))
+
+        if raw is None:
+            raw = file_hits(data, psyq_scan.load_file(ver, lib, path), meta, full, ranges)
+            replace_stale(entry_path, raw_prefix, raw_name)
+            write_entry(os.path.join(entry_path, raw_name), raw)
+
+        hits.extend(raw)
+
+    low = [hit for hit in hits if hit.get('low')]
+    hits = [hit for hit in hits if not hit.get('low')]
+    hits.extend(psyq_scan.near_hits(low, hits, len(data)))
+
+    items = psyq_scan.finish(hits, data, base)
+    replace_stale(entry_path, final_prefix, final_name)
+    write_entry(os.path.join(entry_path, final_name), items)
+
+    return items
+
+
+def main(path, db_path=psyq_scan.DB_PATH, versions=None, base=None, as_json=False, meta_path=None, full=False, cache_path=CACHE_PATH,
+         manifest_path=None):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    # as in psyq_scan.py, a given base means a raw binary
+    ranges = None
+    if base is None:
+        data, base, ranges = psyq_exe.load_input(data, path, psyq_exe.load_manifest(manifest_path))
+
+    psyq_scan.print_results(match(data, db_path, versions, base, meta_path, full, cache_path, ranges), as_json)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Finds PsyQ OBJ signatures in a binary, caching the results')
+    parser.add_argument('path')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-b', '--base', type=lambda x: int(x, 0), help='address of the first byte (default: from the EXE header)')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    parser.add_argument('-j', '--json', action='store_true', help='print results as json')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-f', '--full', action='store_true', help='verify whole signatures, not only unique prefixes')
+    parser.add_argument('-C', '--cache', default=CACHE_PATH, help='cache directory')
+    args = parser.parse_args()
+
+    main(args.path, args.db, args.ver, args.base, args.json, args.index, args.full, args.cache, args.manifest)
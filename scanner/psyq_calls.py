@@ -0,0 +1,87 @@
+import re
+import struct
+
+
+AGREE_BONUS = 8.0
+CONFLICT_PENALTY = 8.0
+SECTION_LABEL_R = re.compile(r'^(text|data|rdata|sdata|bss|sbss)_[0-9A-F]+$')
+
+
+def jal_target(word, address):
+    return ((address + 4) & 0xF0000000) | ((word & 0x03FFFFFF) << 2)
+
+
+def symbol_name(hit, name):
+    # section relative names are only unique inside their OBJ
+    if SECTION_LABEL_R.match(name) is not None:
+        return '%s_%s' % (hit['sig']['name'].split('.')[0], name)
+
+    return name
+
+
+def decode_calls(hit, data, base=0):
+    # (call, target address) for every jal recorded in the signature
+    calls = list()
+
+    for call in hit['sig'].get('calls', ()):
+        offset = hit['offset'] + call['offset']
+        word = struct.unpack_from('<I', data, offset)[0]
+        calls.append((call, jal_target(word, base + offset)))
+
+    return calls
+
+
+def label_map(hits, base=0):
+    addrs = dict()
+    names = dict()
+
+    for hit in hits:
+        for label in hit['sig']['labels']:
+            address = base + hit['offset'] + label['offset']
+            name = symbol_name(hit, label['name'])
+            addrs.setdefault(address, set()).add(name)
+            names.setdefault(name, set()).add(address)
+
+    return addrs, names
+
+
+def cross_check(hits, data, base=0):
+    # a call agrees when another hit defines the callee right where the jal points
+    addrs, names = label_map(hits, base)
+
+    for hit in hits:
+        bonus = 0.0
+
+        for call, target in decode_calls(hit, data, base):
+            name = symbol_name(hit, call['name'])
+
+            if name in addrs.get(target, ()):
+                bonus += AGREE_BONUS
+            elif len(names.get(name, ())) == 1:
+                # the callee was found somewhere else
+                bonus -= CONFLICT_PENALTY
+
+        hit['bonus'] = bonus
+
+    return hits
+
+
+def callee_labels(hits, data, base=0):
+    # names every jal target of the chosen hits that no hit labels yet; a call landing
+    # on a label of another name is a conflict, one of the two hits is likely wrong
+    addrs, _ = label_map(hits, base)
+    labels = dict()
+    conflicts = list()
+
+    for hit in hits:
+        for call, target in decode_calls(hit, data, base):
+            name = symbol_name(hit, call['name'])
+            known = addrs.get(target)
+
+            if known is None:
+                labels.setdefault(target, name)
+            elif name not in known:
+                conflicts.append({'address': target, 'conflict': name, 'caller': base + hit['offset'] + call['offset'],
+                                  'labels': sorted(known)})
+
+    return labels, conflicts
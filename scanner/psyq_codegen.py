@@ -0,0 +1,323 @@
+import struct
+import argparse
+
+import psyq_scan
+
+
+HEADER = r'''/* Generated by psyq_codegen.py for versions %(versions)s, do not edit. */
+/* cc -O2 -o psyq_match psyq_match.c && ./psyq_match [-b base] file.bin */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	const char* sVer;
+	const char* sLib;
+	const char* sObj;
+	unsigned	iSize;
+	unsigned	iFixed;
+	unsigned	iVer;
+	unsigned	iFirstLabel;
+	unsigned	iLabels;
+} SSig;
+
+typedef struct
+{
+	const char* sName;
+	unsigned	iOffset;
+} SLabel;
+
+typedef struct
+{
+	unsigned	iOffset;
+	unsigned	iSig;
+	double		fWeight;
+} SHit;
+
+'''
+
+RUNTIME = r'''
+static	SHit* pHits;
+static	size_t	iHits, iHitsMax;
+
+static	void	AddHit(unsigned iOffset, unsigned iSig)
+{
+	if (iHits == iHitsMax)
+	{
+		iHitsMax = iHitsMax ? iHitsMax * 2 : 1024;
+		if ((pHits = realloc(pHits, iHitsMax * sizeof(SHit))) == NULL)
+		{
+			fprintf(stderr, "*ERROR* : Out of memory\n");
+			exit(1);
+		}
+	}
+	pHits[iHits].iOffset = iOffset;
+	pHits[iHits].iSig = iSig;
+	iHits++;
+}
+
+static	int		Check(const unsigned char* p, const unsigned* pValue, const unsigned char* pMask, unsigned iWords)
+{
+	unsigned	i;
+
+	for (i = 0; i < iWords; ++i, p += 4)
+	{
+		unsigned	w = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+
+		if ((w & Masks[pMask[i]]) != pValue[i])
+			return 0;
+	}
+	return 1;
+}
+'''
+
+MAIN = r'''static	unsigned	End(const SHit* pHit)
+{
+	return pHit->iOffset + Sigs[pHit->iSig].iSize;
+}
+
+/*	same order as psyq_scan.resolve(): end, offset, signature id */
+static	int		CompareHits(const void* a, const void* b)
+{
+	const SHit* x = a;
+	const SHit* y = b;
+
+	if (End(x) != End(y))
+		return End(x) < End(y) ? -1 : 1;
+	if (x->iOffset != y->iOffset)
+		return x->iOffset < y->iOffset ? -1 : 1;
+	return x->iSig < y->iSig ? -1 : x->iSig > y->iSig;
+}
+
+/*	weights and weighted interval scheduling as in psyq_scan.weigh() and resolve() */
+static	void	Resolve(unsigned iBase)
+{
+	double		pVotes[VERSIONS] = { 0 };
+	double		fTop = 0;
+	double* pBest;
+	size_t* pPrev;
+	size_t* pChosen;
+	size_t		i, j, n = 0;
+
+	for (i = 0; i < iHits; ++i)
+		pVotes[Sigs[pHits[i].iSig].iVer] += Sigs[pHits[i].iSig].iFixed;
+	for (i = 0; i < VERSIONS; ++i)
+		if (pVotes[i] > fTop)
+			fTop = pVotes[i];
+	if (fTop == 0)
+		fTop = 1;
+	for (i = 0; i < iHits; ++i)
+		pHits[i].fWeight = Sigs[pHits[i].iSig].iFixed * (1.0 + pVotes[Sigs[pHits[i].iSig].iVer] / fTop);
+
+	qsort(pHits, iHits, sizeof(SHit), CompareHits);
+
+	pBest = calloc(iHits + 1, sizeof(double));
+	pPrev = calloc(iHits + 1, sizeof(size_t));
+	pChosen = calloc(iHits + 1, sizeof(size_t));
+	if (pBest == NULL || pPrev == NULL || pChosen == NULL)
+	{
+		fprintf(stderr, "*ERROR* : Out of memory\n");
+		exit(1);
+	}
+
+	for (j = 0; j < iHits; ++j)
+	{
+		size_t	lo = 0, hi = j;
+
+		/*	bisect_right(ends, offset, 0, j) */
+		while (lo < hi)
+		{
+			size_t	mid = (lo + hi) / 2;
+
+			if (pHits[j].iOffset < End(&pHits[mid]))
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		pPrev[j] = lo;
+		pBest[j + 1] = pBest[j] > pBest[lo] + pHits[j].fWeight ? pBest[j] : pBest[lo] + pHits[j].fWeight;
+	}
+
+	j = iHits;
+	while (j > 0)
+	{
+		if (pBest[j] == pBest[j - 1])
+			j--;
+		else
+		{
+			pChosen[n++] = j - 1;
+			j = pPrev[j - 1];
+		}
+	}
+
+	while (n--)
+	{
+		const SHit* pHit = &pHits[pChosen[n]];
+		const SSig* pSig = &Sigs[pHit->iSig];
+
+		printf("%08X %s %s/%s\n", iBase + pHit->iOffset, pSig->sVer, pSig->sLib, pSig->sObj);
+		for (i = 0; i < pSig->iLabels; ++i)
+		{
+			const SLabel* pLabel = &Labels[pSig->iFirstLabel + i];
+
+			printf("    %08X %s\n", iBase + pHit->iOffset + pLabel->iOffset, pLabel->sName);
+		}
+	}
+
+	free(pBest);
+	free(pPrev);
+	free(pChosen);
+}
+
+int		main(int argc, char* argv[])
+{
+	FILE* f;
+	unsigned char* pData;
+	long	iSize;
+	unsigned	iBase = 0;
+	unsigned	pos;
+
+	if (argc == 4 && strcmp(argv[1], "-b") == 0)
+	{
+		iBase = (unsigned)strtoul(argv[2], NULL, 0);
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s [-b base] file.bin\n", argv[0]);
+		return 1;
+	}
+
+	if ((f = fopen(argv[1], "rb")) == NULL)
+	{
+		fprintf(stderr, "*ERROR* : Couldn't open %s\n", argv[1]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	iSize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	/*	zero padded, the last word of a signature may reach past the end */
+	if ((pData = calloc(iSize + 4, 1)) == NULL || fread(pData, 1, iSize, f) != (size_t)iSize)
+	{
+		fprintf(stderr, "*ERROR* : Couldn't read %s\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+
+	for (pos = 0; pos + 4 <= (unsigned long)iSize; pos += 4)
+	{
+		unsigned	w = pData[pos] | (pData[pos + 1] << 8) | (pData[pos + 2] << 16) | ((unsigned)pData[pos + 3] << 24);
+
+		Dispatch(pData, (unsigned)iSize, pos, w);
+	}
+
+	Resolve(iBase);
+	free(pData);
+	free(pHits);
+
+	return 0;
+}
+'''
+
+
+def c_string(text):
+    return '"%s"' % text.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def table(values, fmt, per_line=12):
+    lines = list()
+
+    for i in range(0, len(values), per_line):
+        lines.append('\t' + ' '.join(fmt % v + ',' for v in values[i:i + per_line]))
+
+    return '\n'.join(lines)
+
+
+def generate(sigs, versions):
+    # groups are verified once for all identical signatures, like build_index() does
+    sigs = sorted(sigs, key=lambda s: s['id'])
+    index = psyq_scan.build_index(sigs)
+    order = dict((sig['id'], i) for i, sig in enumerate(sigs))
+    ver_ids = dict((ver, i) for i, ver in enumerate(sorted(set(s['ver'] for s in sigs))))
+    out = [HEADER.replace('%(versions)s', ', '.join(versions or ['all']))]
+
+    out.append('#define\tVERSIONS\t%d\n\n' % max(1, len(ver_ids)))
+
+    labels = list()
+    out.append('static\tconst SSig\tSigs[] =\n{\n')
+    for sig in sigs:
+        out.append('\t{ %s, %s, %s, %d, %d, %d, %d, %d },\n' % (
+            c_string(sig['ver']), c_string(sig['lib']), c_string(sig['name']),
+            sig['size'], sig['fixed'], ver_ids[sig['ver']], len(labels), len(sig['labels'])))
+        labels.extend(sig['labels'])
+    out.append('};\n\n')
+
+    out.append('static\tconst SLabel\tLabels[] =\n{\n')
+    for label in labels or [{'name': '', 'offset': 0}]:
+        out.append('\t{ %s, %d },\n' % (c_string(label['name']), label['offset']))
+    out.append('};\n\n')
+
+    # masks are per word, a handful of distinct ones cover the whole DB
+    masks = dict()
+    groups = [g for g in index['groups'] if 'anchor' in g]
+
+    for n, group in enumerate(groups):
+        # a data signature may end inside a word, the rest of it is masked out
+        count = (group['size'] + 3) // 4
+        words = struct.unpack('<%dI' % count, group['value'].to_bytes(count * 4, 'little'))
+        mask_ids = [masks.setdefault(m, len(masks)) for m in struct.unpack('<%dI' % count, group['mask'].to_bytes(count * 4, 'little'))]
+
+        out.append('static\tconst unsigned\tV%d[] =\n{\n%s\n};\n' % (n, table(words, '0x%08X')))
+        out.append('static\tconst unsigned char\tM%d[] =\n{\n%s\n};\n' % (n, table(mask_ids, '%d', 32)))
+
+    if len(masks) > 256:
+        raise ValueError('%d different masks, more than a mask index can hold' % len(masks))
+
+    out.append('\nstatic\tconst unsigned\tMasks[] =\n{\n%s\n};\n' % table(sorted(masks, key=masks.get), '0x%08X', 6))
+    out.append(RUNTIME)
+
+    # one case per anchor word, the compiler lays out the dispatch
+    group_ids = dict((id(g), n) for n, g in enumerate(groups))
+    out.append('\nstatic\tvoid\tDispatch(const unsigned char* pData, unsigned iSize, unsigned pos, unsigned w)\n{\n')
+    out.append('\tunsigned\tstart;\n\n\tswitch (w)\n\t{\n')
+
+    for word in sorted(index['words']):
+        out.append('\tcase 0x%08X:\n' % word)
+
+        for group in index['words'][word]:
+            n = group_ids[id(group)]
+            out.append('\t\tstart = pos - %d;\n' % group['anchor'])
+            # pos is unsigned, there is nothing to compare for an anchor on the first word
+            bound = 'pos >= %d && ' % group['anchor'] if group['anchor'] else ''
+            out.append('\t\tif (%sstart + %d <= iSize && Check(pData + start, V%d, M%d, %d))\n\t\t{\n' % (
+                bound, group['size'], n, n, (group['size'] + 3) // 4))
+
+            for sig in group['sigs']:
+                out.append('\t\t\tAddHit(start, %d);\n' % order[sig['id']])
+
+            out.append('\t\t}\n')
+
+        out.append('\t\tbreak;\n')
+
+    out.append('\t}\n}\n\n')
+    out.append(MAIN)
+
+    return ''.join(out)
+
+
+def main(out_path, db_path=psyq_scan.DB_PATH, versions=None):
+    with open(out_path, 'w') as w:
+        w.write(generate(psyq_scan.load_db(db_path, versions), versions))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generates a C matcher with the signature DB built in')
+    parser.add_argument('out_path')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    args = parser.parse_args()
+
+    main(args.out_path, args.db, args.ver)
@@ -0,0 +1,83 @@
+import re
+import sys
+
+
+PARTIAL_R = re.compile(rb'[^\xFF]+')
+
+
+def set_words(bitmap, first, last):
+    # sets the bits of words [first, last), whole bytes at once
+    while first < last and first & 7:
+        bitmap[first >> 3] |= 1 << (first & 7)
+        first += 1
+
+    while last > first and last & 7:
+        last -= 1
+        bitmap[last >> 3] |= 1 << (last & 7)
+
+    bitmap[first >> 3:last >> 3] = b'\xFF' * ((last - first) >> 3)
+
+
+def clear_runs(bitmap, count):
+    # [first, last) of every run of clear bits among the first count: bytes with all bits set
+    # are skipped by the regex engine, only the bytes around a gap are taken as a number
+    runs = list()
+
+    for m in PARTIAL_R.finditer(bitmap):
+        bits = ~int.from_bytes(m.group(), 'little') & ((1 << (len(m.group()) * 8)) - 1)
+        base = m.start() * 8
+
+        while bits:
+            first = (bits & -bits).bit_length() - 1
+            rest = bits + (1 << first)  # the carry clears the run
+            last = (rest & -rest).bit_length() - 1
+            bits &= ~((1 << last) - 1)
+
+            if base + first < count:
+                runs.append((base + first, min(count, base + last)))
+
+    return runs
+
+
+def coverage(items, start, end):
+    # identified share of the words in [start, end) (addresses), per LIB, and the unidentified runs
+    count = max(0, end - start) // 4
+    bitmap = bytearray((count + 7) // 8)
+    libs = dict()
+
+    for item in items:
+        if 'obj' not in item:
+            continue
+
+        first = max(0, (item['address'] - start) // 4)
+        last = min(count, (item['address'] + item['size'] - start + 3) // 4)
+
+        if first < last:
+            set_words(bitmap, first, last)
+            libs[item['lib']] = libs.get(item['lib'], 0) + last - first
+
+    unknown = [(start + first * 4, start + last * 4) for first, last in clear_runs(bitmap, count)]
+    identified = count - sum(last - first for first, last in unknown) // 4
+
+    return {
+        'start': start,
+        'end': start + count * 4,
+        'words': count,
+        'identified': identified,
+        'libs': dict((lib, words) for lib, words in sorted(libs.items())),
+        'unknown': unknown
+    }
+
+
+def print_coverage(cov, out=sys.stdout):
+    def share(words):
+        return 100.0 * words / cov['words'] if cov['words'] else 0.0
+
+    out.write('%08X-%08X %.1f%% identified (%d of %d words)\n' % (
+        cov['start'], cov['end'], share(cov['identified']), cov['identified'], cov['words']))
+
+    for lib, words in sorted(cov['libs'].items(), key=lambda x: -x[1]):
+        out.write('    %5.1f%% %s\n' % (share(words), lib))
+
+    for first, last in cov['unknown']:
+        out.write('    %08X-%08X unidentified (0x%X bytes)\n' % (first, last, last - first))
@@ -0,0 +1,173 @@
+import os
+import sys
+import json
+import socket
+import argparse
+import threading
+import socketserver
+from multiprocessing import shared_memory, resource_tracker
+
+import psyq_exe
+import psyq_scan
+
+
+SOCKET_PATH = '/tmp/psyq_scan.sock'
+QUEUE_SIZE = 64  # requests accepted but not answered yet, over all clients
+
+
+def load_request(req):
+    # the binary comes from a file or from a shared memory block of the client
+    if 'shm' in req:
+        shm = shared_memory.SharedMemory(req['shm'])
+        # the block belongs to the client, the worker must not remove it when it exits.
+        # The tracker knows it by its POSIX name, the one with the leading slash
+        resource_tracker.unregister('/' + shm.name, 'shared_memory')
+
+        try:
+            return bytes(shm.buf[:req.get('size', shm.size)])
+        finally:
+            shm.close()
+
+    with open(req['path'], 'rb') as f:
+        return f.read()
+
+
+def scan_request(req):
+    try:
+        data = load_request(req)
+
+        # without a base, the text of an EXE is scanned at the address from its header
+        if 'base' in req:
+            base, ranges = req['base'], None
+        else:
+            data, base, ranges = psyq_exe.load_input(data)
+
+        return {'id': req.get('id'), 'results': psyq_scan.match(data, psyq_scan.worker['index'], base, ranges)}
+    except Exception as e:
+        return {'id': req.get('id'), 'error': str(e)}
+
+
+class Handler(socketserver.StreamRequestHandler):
+    # one json line per request: a request object or a list of them (a batch),
+    # answered by one json line in the same shape
+    def handle(self):
+        for line in self.rfile:
+            line = line.strip()
+
+            if not line:
+                continue
+
+            try:
+                req = json.loads(line)
+            except ValueError as e:
+                self.reply({'error': 'bad request: %s' % e})
+                continue
+
+            batch = req if isinstance(req, list) else [req]
+            pending = list()
+
+            for item in batch:
+                # waits while the server holds too many requests
+                self.server.slots.acquire()
+                release = lambda _: self.server.slots.release()
+                pending.append(self.server.pool.apply_async(scan_request, (item,), callback=release, error_callback=release))
+
+            items = [p.get() for p in pending]
+            self.reply(items if isinstance(req, list) else items[0])
+
+    def reply(self, item):
+        self.wfile.write(json.dumps(item).encode() + b'\n')
+        self.wfile.flush()
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+
+def serve(socket_path=SOCKET_PATH, db_path=psyq_scan.DB_PATH, versions=None, meta_path=None, jobs=None):
+    if os.path.exists(socket_path):
+        # left behind by a server that is gone, unless one still answers on it
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+            try:
+                s.connect(socket_path)
+            except OSError:
+                os.unlink(socket_path)
+            else:
+                raise ValueError('%s: a server is already running' % socket_path)
+
+    with psyq_scan.worker_pool(jobs, db_path, versions, meta_path) as pool:
+        with Server(socket_path, Handler) as server:
+            server.pool = pool
+            server.slots = threading.BoundedSemaphore(QUEUE_SIZE)
+
+            try:
+                server.serve_forever()
+            except KeyboardInterrupt:
+                pass
+            finally:
+                os.unlink(socket_path)
+
+
+def request(socket_path, batch):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(socket_path)
+        s.sendall(json.dumps(batch).encode() + b'\n')
+
+        with s.makefile('rb') as f:
+            return json.loads(f.readline())
+
+
+def client(socket_path, paths, base=None, use_shm=False):
+    # stand-in client: sends all files as one batch and prints the results
+    blocks = list()
+    batch = list()
+
+    try:
+        for i, path in enumerate(paths):
+            req = {'id': i, 'path': os.path.abspath(path)}
+
+            if use_shm:
+                with open(path, 'rb') as f:
+                    data = f.read()
+
+                shm = shared_memory.SharedMemory(create=True, size=max(1, len(data)))
+                blocks.append(shm)
+                shm.buf[:len(data)] = data
+                req = {'id': i, 'shm': shm.name, 'size': len(data)}
+
+            if base is not None:
+                req['base'] = base
+            batch.append(req)
+
+        items = request(socket_path, batch)
+    finally:
+        for shm in blocks:
+            shm.close()
+            shm.unlink()
+
+    for path, item in zip(paths, items):
+        sys.stdout.write('==%s==\n' % path)
+
+        if 'error' in item:
+            sys.stdout.write('*ERROR* : %s\n' % item['error'])
+        else:
+            psyq_scan.print_results(item['results'])
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Scan server keeping the signature index in memory')
+    parser.add_argument('paths', nargs='*', help='with -c, files to scan')
+    parser.add_argument('-s', '--socket', default=SOCKET_PATH, help='unix socket path')
+    parser.add_argument('-c', '--client', action='store_true', help='send the files to a running server')
+    parser.add_argument('-m', '--shm', action='store_true', help='with -c, pass the files in shared memory')
+    parser.add_argument('-b', '--base', type=lambda x: int(x, 0), help='with -c, address of the first byte (default: from the EXE header)')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-j', '--jobs', type=int, help='number of worker processes')
+    args = parser.parse_args()
+
+    if args.client:
+        client(args.socket, args.paths, args.base, args.shm)
+    else:
+        serve(args.socket, args.db, args.ver, args.index, args.jobs)
@@ -0,0 +1,229 @@
+import re
+import math
+import json
+import struct
+import hashlib
+import argparse
+from collections import Counter
+
+import psyq_scan
+
+
+LOCAL_LABEL_R = re.compile(r'^(loc|text|ctors|dtors)_[0-9A-F]+$')
+FULL_WORD = 0xFFFFFFFF
+GRAMS_PER_SIG = 4
+MIN_CHECK_FIXED = 16  # a prefix is only unique within the DB, real code needs this many fixed bytes
+
+# below any of these a signature is only looked for near other hits
+MIN_FIXED = 24
+MIN_ENTROPY = 2.5  # bits per fixed byte
+MAX_COLLISIONS = 2  # other DB signatures it is found in
+
+
+def words(value, mask):
+    count = len(value) // 4
+    return struct.unpack('<%dI' % count, value[:count * 4]), struct.unpack('<%dI' % count, mask[:count * 4])
+
+
+def unique_prefixes(patterns):
+    # patterns: list of (value, mask). Returns the number of bytes that tell
+    # each pattern apart from every other one, '??' being compatible with anything.
+    # Groups hold patterns that are pairwise compatible on the words before depth.
+    decoded = [words(v, m) for v, m in patterns]
+    sizes = [len(v) for v, _ in patterns]
+    result = [0] * len(patterns)
+    stack = [(list(range(len(patterns))), 0, 1)]
+
+    while stack:
+        group, depth, floor = stack.pop()
+        rest = list()
+
+        for p in group:
+            if len(decoded[p][0]) <= depth:
+                # a prefix of every other member, only the full length will do
+                result[p] = sizes[p]
+                floor = depth + 1
+            else:
+                rest.append(p)
+
+        if len(rest) == 1:
+            p = rest[0]
+            result[p] = max(result[p], min(sizes[p], max(floor, depth) * 4))
+            continue
+
+        buckets = dict()
+        wild = list()
+
+        for p in rest:
+            value, mask = decoded[p][0][depth], decoded[p][1][depth]
+
+            if mask == FULL_WORD:
+                buckets.setdefault(value, list()).append(p)
+            else:
+                wild.append(p)
+
+        for p in wild:
+            value, mask = decoded[p][0][depth], decoded[p][1][depth]
+            placed = False
+
+            for key, bucket in buckets.items():
+                if (key ^ value) & mask == 0:
+                    bucket.append(p)
+                    placed = True
+
+            if not placed and len(wild) == 1:
+                result[p] = max(result[p], min(sizes[p], max(floor, depth + 1) * 4))
+
+        if len(wild) > 1:
+            # wildcard words are conservatively treated as compatible with each other
+            buckets[None] = wild
+
+        for bucket in buckets.values():
+            stack.append((bucket, depth + 1, floor))
+
+    return result
+
+
+def check_length(mask, prefix):
+    # prefix grown by whole words until it holds MIN_CHECK_FIXED fixed bytes (or the whole pattern)
+    length = prefix
+
+    while length < len(mask) and mask[:length].count(0xFF) < MIN_CHECK_FIXED:
+        length = min(len(mask), (length + 4) & ~3)
+
+    return length
+
+
+def required_grams(patterns):
+    # the least common fixed 8-byte grams of every pattern, all must be in a binary it matches
+    grams = [psyq_scan.fixed_grams(v, m) for v, m in patterns]
+    freq = Counter(g for items in grams for g in set(g for _, g in items))
+    result = list()
+
+    for items in grams:
+        rare = sorted(set(g for _, g in items), key=lambda g: (freq[g], g))[:GRAMS_PER_SIG]
+        result.append(['%016X' % g for g in rare])
+
+    return result
+
+
+def entropy(value, mask):
+    counts = Counter(b for b, m in zip(value, mask) if m == 0xFF)
+    total = sum(counts.values())
+
+    return -sum(n / total * math.log2(n / total) for n in counts.values()) if total else 0.0
+
+
+def collisions(patterns):
+    # number of other patterns each one is found in, scanning the DB with itself
+    index = psyq_scan.build_index([{'id': n, 'value': v, 'mask': m, 'size': len(v)} for n, (v, m) in enumerate(patterns)])
+    result = [0] * len(patterns)
+
+    for n, (value, _) in enumerate(patterns):
+        for found in set(hit['sig']['id'] for hit in psyq_scan.scan(value, index)):
+            if found != n:
+                result[found] += 1
+
+    return result
+
+
+def specificity(patterns):
+    result = list()
+
+    for (value, mask), count in zip(patterns, collisions(patterns)):
+        item = {
+            'fixed': mask.count(0xFF),
+            'entropy': round(entropy(value, mask), 3),
+            'collisions': count
+        }
+
+        if item['fixed'] < MIN_FIXED or item['entropy'] < MIN_ENTROPY or count > MAX_COLLISIONS:
+            item['low'] = True
+
+        result.append(item)
+
+    return result
+
+
+def function_slices(sig):
+    # [start, end) of every function, local branch labels are not functions
+    starts = sorted(set(l['offset'] for l in sig['labels'] if LOCAL_LABEL_R.match(l['name']) is None))
+    slices = list()
+
+    for i, start in enumerate(starts):
+        end = starts[i + 1] if i + 1 < len(starts) else sig['size']
+
+        if end > start:
+            names = [l['name'] for l in sig['labels'] if l['offset'] == start]
+            slices.append((names[0], start, end))
+
+    return slices
+
+
+def slice_hash(sig, start, end):
+    # relocated bytes are 00 in value and mask, two slices hash alike when they
+    # only differ in what the linker fills in
+    return hashlib.sha1(sig['value'][start:end] + sig['mask'][start:end]).hexdigest()[:16]
+
+
+def function_hashes(sigs):
+    # {(lib, obj, function): hash} of the code signatures of one version
+    hashes = dict()
+
+    for sig in sigs:
+        if 'section' in sig:
+            continue
+
+        for name, start, end in function_slices(sig):
+            hashes[(sig['lib'], sig['name'], name)] = slice_hash(sig, start, end)
+
+    return hashes
+
+
+def build(db_path=psyq_scan.DB_PATH, versions=None):
+    sigs = psyq_scan.load_db(db_path, versions)
+    meta = dict((sig['id'], {'size': sig['size']}) for sig in sigs)
+
+    # whole OBJs
+    keys = dict()
+    for sig in sigs:
+        keys.setdefault((sig['value'], sig['mask']), list()).append(sig['id'])
+
+    patterns = list(keys)
+    for pattern, prefix, grams, spec in zip(patterns, unique_prefixes(patterns), required_grams(patterns), specificity(patterns)):
+        for sig_id in keys[pattern]:
+            meta[sig_id]['prefix'] = check_length(pattern[1], prefix)
+            meta[sig_id]['grams'] = grams
+            meta[sig_id].update(spec)
+
+    # function slices, identical ones (mostly the same function in several versions) once
+    keys = dict()
+    patterns = dict()
+    for sig in sigs:
+        for name, start, end in function_slices(sig):
+            h = slice_hash(sig, start, end)
+            patterns.setdefault(h, (sig['value'][start:end], sig['mask'][start:end]))
+            keys.setdefault(h, list()).append((sig['id'], name))
+
+    for h, prefix in zip(patterns, unique_prefixes(list(patterns.values()))):
+        for sig_id, name in keys[h]:
+            meta[sig_id].setdefault('funcs', dict())[name] = check_length(patterns[h][1], prefix)
+
+    return meta
+
+
+def main(out_path, db_path=psyq_scan.DB_PATH, versions=None):
+    meta = build(db_path, versions)
+
+    with open(out_path, 'w') as w:
+        json.dump(meta, w)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Builds the scanner index data for the signature DB')
+    parser.add_argument('out_path')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions')
+    args = parser.parse_args()
+
+    main(args.out_path, args.db, args.ver)
@@ -0,0 +1,65 @@
+import argparse
+
+import psyq_db
+import psyq_scan
+
+
+STATES = ('unchanged', 'changed', 'added', 'removed')
+
+
+def diff(old, new):
+    # {lib: {state: [(obj, function)]}} between the function hashes of two versions
+    libs = dict()
+
+    for key in set(old) | set(new):
+        lib, obj, name = key
+
+        if key not in old:
+            state = 'added'
+        elif key not in new:
+            state = 'removed'
+        elif old[key] == new[key]:
+            state = 'unchanged'
+        else:
+            state = 'changed'
+
+        libs.setdefault(lib, dict((s, list()) for s in STATES))[state].append((obj, name))
+
+    return libs
+
+
+def print_diff(old_ver, new_ver, libs, names=False):
+    print('%s -> %s' % (old_ver, new_ver))
+    print('%-16s %10s %10s %10s %10s' % (('LIB',) + STATES))
+
+    for lib in sorted(libs):
+        print('%-16s %10d %10d %10d %10d' % ((lib,) + tuple(len(libs[lib][s]) for s in STATES)))
+
+        if names:
+            for state, mark in (('changed', '*'), ('added', '+'), ('removed', '-')):
+                for obj, name in sorted(libs[lib][state]):
+                    print('    %s %s/%s' % (mark, obj, name))
+
+    print()
+
+
+def main(db_path=psyq_scan.DB_PATH, versions=None, names=False):
+    # consecutive pairs of the versions, in DB order
+    hashes = dict()
+
+    for ver, lib, path in psyq_scan.db_files(db_path, versions):
+        hashes.setdefault(ver, dict()).update(psyq_db.function_hashes(psyq_scan.load_file(ver, lib, path)))
+
+    order = list(hashes)
+    for old_ver, new_ver in zip(order, order[1:]):
+        print_diff(old_ver, new_ver, diff(hashes[old_ver], hashes[new_ver]), names)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Which functions changed between SDK versions, per LIB')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only compare these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-n', '--names', action='store_true', help='list the functions changed, added and removed')
+    args = parser.parse_args()
+
+    main(args.db, args.ver, args.names)
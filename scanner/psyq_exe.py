@@ -0,0 +1,92 @@
+import os
+import json
+import struct
+import argparse
+
+
+EXE_MAGIC = b'PS-X EXE'
+HEADER_SIZE = 0x800  # not loaded, t_addr is the address of the byte after it
+HEADER_FIELDS = ('pc0', 'gp0', 't_addr', 't_size', 'd_addr', 'd_size', 'b_addr', 'b_size', 's_addr', 's_size')
+
+
+def parse_header(data):
+    # the fields of a PS-X EXE header from 0x10 on, None for anything else
+    if bytes(data[:8]) != EXE_MAGIC or len(data) < HEADER_SIZE:
+        return None
+
+    return dict(zip(HEADER_FIELDS, struct.unpack_from('<10I', data, 0x10)))
+
+
+def load_manifest(path):
+    # overlays: {"file": load address}, addresses as numbers or strings like "0x80100000"
+    if path is None:
+        return dict()
+
+    with open(path) as f:
+        items = json.load(f)
+
+    return dict((name, address if isinstance(address, int) else int(address, 0)) for name, address in items.items())
+
+
+def overlay_address(name, manifest):
+    if name is None or not manifest:
+        return None
+
+    # disc images name files with backslashes
+    for key in (name, name.replace('\\', '/').split('/')[-1]):
+        for k in (key, key.upper()):
+            if k in manifest:
+                return manifest[k]
+
+    return None
+
+
+def layout(data, name=None, manifest=None, size=None):
+    # (address of the first byte, [start, end) to scan) of an input: the text image of
+    # a PS-X EXE, a whole overlay at its manifest address or a whole binary at 0.
+    # data may be only the head of the file when its size is given
+    size = len(data) if size is None else size
+    header = parse_header(data)
+
+    if header is not None:
+        return header['t_addr'] - HEADER_SIZE, [(HEADER_SIZE, min(size, HEADER_SIZE + header['t_size']))]
+
+    address = overlay_address(name, manifest)
+
+    return address or 0, [(0, size)]
+
+
+def load_input(data, name=None, manifest=None):
+    # layout() with data cut after the part signatures may cover, a data segment
+    # or padding after the text image is not code
+    base, ranges = layout(data, name, manifest)
+
+    return data[:ranges[-1][1]], base, ranges
+
+
+def read_layout(path, manifest=None):
+    with open(path, 'rb') as f:
+        return layout(f.read(HEADER_SIZE), path, manifest, os.fstat(f.fileno()).st_size)
+
+
+def main(paths, manifest_path=None):
+    manifest = load_manifest(manifest_path)
+
+    for path in paths:
+        with open(path, 'rb') as f:
+            header = parse_header(f.read(HEADER_SIZE))
+
+        base, ranges = read_layout(path, manifest)
+        start, end = ranges[0]
+        kind = 'exe pc0 %08X gp0 %08X' % (header['pc0'], header['gp0']) if header is not None else 'raw'
+
+        print('%s %08X-%08X %s' % (path, base + start, base + end, kind))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Shows where the code of PS-X EXEs and overlays is loaded')
+    parser.add_argument('paths', nargs='+')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    args = parser.parse_args()
+
+    main(args.paths, args.manifest)
@@ -0,0 +1,137 @@
+import argparse
+
+import psyq_scan
+
+
+REGION_SIZE = 0x1000  # hits are kept in buckets of this many bytes by their offset
+
+
+class Session(object):
+    # the raw hits of one binary that keeps changing in place (patches, redefined code):
+    # after an edit only the signatures whose bytes overlap it are verified again
+
+    def __init__(self, data, index):
+        # no gram prefilter, it holds for the bytes of the binary at one time only
+        self.data = bytearray(data)
+        self.index = index
+        self.regions = dict()
+
+        for hit in psyq_scan.scan(self.data, self.index):
+            self.add(hit)
+
+    def add(self, hit):
+        self.regions.setdefault(hit['offset'] // REGION_SIZE, dict())[(hit['offset'], hit['sig']['id'])] = hit
+
+    def remove(self, hit):
+        region = self.regions[hit['offset'] // REGION_SIZE]
+        del region[(hit['offset'], hit['sig']['id'])]
+
+        if not region:
+            del self.regions[hit['offset'] // REGION_SIZE]
+
+    def overlapping(self, start, end):
+        # the hits with a byte in [start, end), none starts more than max_size before it
+        found = list()
+
+        for n in range(max(0, start - self.index['max_size']) // REGION_SIZE, (end - 1) // REGION_SIZE + 1):
+            for hit in self.regions.get(n, dict()).values():
+                if hit['offset'] < end and hit['offset'] + hit['sig']['size'] > start:
+                    found.append(hit)
+
+        return found
+
+    def patch(self, offset, data):
+        # the binary keeps its size, as in a disassembler database
+        if offset < 0 or offset + len(data) > len(self.data):
+            raise ValueError('patch at 0x%X past the end of the binary' % offset)
+
+        self.data[offset:offset + len(data)] = data
+
+        return self.rescan([(offset, offset + len(data))])
+
+    def rescan(self, ranges):
+        # ranges: [start, end) of the bytes changed in self.data since the last call.
+        # Returns the hits that appeared and the ones that are gone
+        added = list()
+        removed = list()
+        margin = self.index['max_size']
+
+        for start, end in merge(ranges, len(self.data)):
+            old = dict(((hit['offset'], hit['sig']['id']), hit) for hit in self.overlapping(start, end))
+            new = dict()
+
+            # anchors lie within a signature size of the bytes it covers
+            for hit in psyq_scan.scan(self.data, self.index, max(0, start - margin), min(len(self.data), end + margin)):
+                if hit['offset'] < end and hit['offset'] + hit['sig']['size'] > start:
+                    new[(hit['offset'], hit['sig']['id'])] = hit
+
+            for key in old.keys() - new.keys():
+                self.remove(old[key])
+                removed.append(old[key])
+
+            for key in new.keys() - old.keys():
+                self.add(new[key])
+                added.append(new[key])
+
+        return {'added': added, 'removed': removed}
+
+    def hits(self):
+        return sorted((hit for region in self.regions.values() for hit in region.values()),
+                      key=lambda hit: (hit['offset'], hit['sig']['id']))
+
+    def results(self, base=0):
+        # the whole binary, as psyq_scan.match() gives it
+        hits = psyq_scan.keep_near(self.hits(), self.index, len(self.data))
+
+        return psyq_scan.finish(hits, bytes(self.data), base)
+
+
+def merge(ranges, size):
+    merged = list()
+
+    for start, end in sorted((max(0, start), min(size, end)) for start, end in ranges):
+        if start >= end:
+            continue
+
+        if merged and start <= merged[-1][1]:
+            merged[-1][1] = max(merged[-1][1], end)
+        else:
+            merged.append([start, end])
+
+    return merged
+
+
+def print_delta(delta, base=0):
+    for mark, name in (('-', 'removed'), ('+', 'added')):
+        for hit in sorted(delta[name], key=lambda hit: (hit['offset'], hit['sig']['id'])):
+            sig = hit['sig']
+            print('%s %08X %s %s/%s' % (mark, base + hit['offset'], sig['ver'], sig['lib'], sig['name']))
+
+
+def parse_patch(text):
+    # offset:hex bytes, e.g. 0x1234:0000000027BDFFE8
+    offset, data = text.split(':')
+    return int(offset, 0), bytes.fromhex(data)
+
+
+def main(path, patches, db_path=psyq_scan.DB_PATH, versions=None, base=0, meta_path=None):
+    index = psyq_scan.build_index(psyq_scan.load_db(db_path, versions), psyq_scan.load_meta(meta_path))
+
+    with open(path, 'rb') as f:
+        session = Session(f.read(), index)
+
+    for offset, data in patches:
+        print_delta(session.patch(offset, data), base)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Shows the signature hits each patch to a binary adds and removes')
+    parser.add_argument('path')
+    parser.add_argument('patches', nargs='+', type=parse_patch, help='offset:hex bytes, applied in order')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-b', '--base', type=lambda x: int(x, 0), default=0, help='address of the first byte')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    args = parser.parse_args()
+
+    main(args.path, args.patches, args.db, args.ver, args.base, args.index)
@@ -0,0 +1,171 @@
+import os
+import re
+import sys
+import mmap
+import json
+import struct
+import argparse
+
+import psyq_exe
+import psyq_scan
+
+
+SYNC = b'\x00' + b'\xFF' * 10 + b'\x00'
+CUE_FILE_R = re.compile(r'^\s*FILE\s+"?([^"]+?)"?\s+BINARY\s*$', re.IGNORECASE | re.MULTILINE)
+BOOT_R = re.compile(r'^\s*BOOT\s*=\s*cdrom0?:\\?([^\s;]+)', re.IGNORECASE | re.MULTILINE)
+CODE_EXTS = ('.EXE', '.BIN', '.OVL', '.OVR', '.DLL', '.PRG')
+MAX_CODE_SIZE = 0x800000  # RAM of a dev unit, a bigger file is not loaded as code
+
+
+class DiscImage(object):
+    def __init__(self, path):
+        self.f = open(path, 'rb')
+        self.data = mmap.mmap(self.f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        if self.data[:12] == SYNC:
+            self.sector_size = 2352
+            self.user_offset = 24 if self.data[15] == 2 else 16
+        else:
+            self.sector_size = 2048
+            self.user_offset = 0
+
+        if self.sector(16)[:6] != b'\x01CD001':
+            self.close()
+            raise ValueError('%s: no ISO9660 volume descriptor' % path)
+
+    def close(self):
+        self.data.close()
+        self.f.close()
+
+    def sector(self, lba):
+        start = lba * self.sector_size + self.user_offset
+        return memoryview(self.data)[start:start + 2048]
+
+    def read(self, lba, size):
+        if self.sector_size == 2048:
+            return memoryview(self.data)[lba * 2048:lba * 2048 + size]
+
+        # Mode2 user data is not contiguous, gathered sector by sector into one buffer
+        data = bytearray(size)
+        for pos in range(0, size, 2048):
+            data[pos:pos + 2048] = self.sector(lba + pos // 2048)[:size - pos]
+
+        return data
+
+    def files(self):
+        root = self.sector(16)[156:156 + 34]
+        lba, size = struct.unpack_from('<I', root, 2)[0], struct.unpack_from('<I', root, 10)[0]
+        items = dict()
+        self.walk(lba, size, '', items, set())
+
+        return items
+
+    def walk(self, lba, size, prefix, items, seen):
+        if lba in seen:
+            return
+        seen.add(lba)
+
+        data = self.read(lba, size)
+        pos = 0
+
+        while pos < len(data):
+            length = data[pos]
+
+            if length == 0:
+                # records never cross a sector boundary
+                pos = (pos // 2048 + 1) * 2048
+                continue
+
+            rec_lba = struct.unpack_from('<I', data, pos + 2)[0]
+            rec_size = struct.unpack_from('<I', data, pos + 10)[0]
+            flags = data[pos + 25]
+            name = bytes(data[pos + 33:pos + 33 + data[pos + 32]])
+            pos += length
+
+            if name in (b'\x00', b'\x01'):
+                continue
+
+            name = prefix + name.decode('ascii', 'replace').split(';')[0].upper()
+
+            if flags & 2:
+                self.walk(rec_lba, rec_size, name + '\\', items, seen)
+            else:
+                items[name] = (rec_lba, rec_size)
+
+
+def image_path(path):
+    # a .cue sheet points at the .bin holding the data track
+    if not path.lower().endswith('.cue'):
+        return path
+
+    with open(path) as f:
+        m = CUE_FILE_R.search(f.read())
+
+    if m is None:
+        raise ValueError('%s: no BINARY file in cue sheet' % path)
+
+    return os.path.join(os.path.dirname(path), m.group(1))
+
+
+def code_files(disc):
+    files = disc.files()
+    boot = None
+
+    if 'SYSTEM.CNF' in files:
+        cnf = bytes(disc.read(*files['SYSTEM.CNF'])).decode('ascii', 'replace')
+        m = BOOT_R.search(cnf)
+
+        if m is not None:
+            boot = m.group(1).upper()
+
+    for name in sorted(files):
+        lba, size = files[name]
+
+        if size > MAX_CODE_SIZE:
+            continue
+
+        head = bytes(disc.read(lba, min(size, 8)))
+
+        if name == boot or head == psyq_exe.EXE_MAGIC or name.endswith(CODE_EXTS):
+            yield name, lba, size, name == boot
+
+
+def scan_image(path):
+    disc = DiscImage(image_path(path))
+    worker = psyq_scan.worker
+    items = list()
+
+    try:
+        for name, lba, size, boot in code_files(disc):
+            # only what layout() scans is read, not the data after the text of an EXE
+            base, ranges = psyq_exe.layout(disc.read(lba, min(size, psyq_exe.HEADER_SIZE)), name, worker['manifest'], size)
+            items.append({
+                'file': name,
+                'boot': boot,
+                'results': psyq_scan.match(disc.read(lba, ranges[-1][1]), worker['index'], base, ranges)
+            })
+    finally:
+        disc.close()
+
+    return {'image': path, 'files': items}
+
+
+def main(paths, db_path=psyq_scan.DB_PATH, versions=None, jobs=None, manifest_path=None, meta_path=None):
+    with psyq_scan.worker_pool(jobs, db_path, versions, meta_path, manifest_path) as pool:
+        for item in pool.imap(scan_image, paths):
+            json.dump(item, sys.stdout)
+            sys.stdout.write('\n')
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Scans the executables of PS1 disc images (BIN/CUE, ISO)')
+    parser.add_argument('paths', nargs='+')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-j', '--jobs', type=int, help='number of worker processes')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    args = parser.parse_args()
+
+    main(args.paths, args.db, args.ver, args.jobs, args.manifest, args.index)
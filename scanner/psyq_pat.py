@@ -0,0 +1,93 @@
+import os
+import argparse
+
+import psyq_db
+import psyq_scan
+
+
+LEAD_SIZE = 32
+CRC_MAX = 255
+
+
+def crc16(data):
+    # the CRC16 variant of IDA's FLAIR tools
+    crc = 0xFFFF
+
+    for b in data:
+        for _ in range(8):
+            if (crc ^ b) & 1:
+                crc = (crc >> 1) ^ 0x8408
+            else:
+                crc >>= 1
+            b >>= 1
+
+    crc = ~crc & 0xFFFF
+
+    return ((crc << 8) | (crc >> 8)) & 0xFFFF
+
+
+def hex_bytes(value, mask):
+    return ''.join('%02X' % v if m else '..' for v, m in zip(value, mask))
+
+
+def pat_line(sig, start, end):
+    value, mask = sig['value'][start:end], sig['mask'][start:end]
+    lead = hex_bytes(value[:LEAD_SIZE], mask[:LEAD_SIZE]).ljust(LEAD_SIZE * 2, '.')
+
+    # the CRC covers the fixed bytes after the lead, up to the first '??'
+    crc_len = 0
+    while LEAD_SIZE + crc_len < len(value) and crc_len < CRC_MAX and mask[LEAD_SIZE + crc_len]:
+        crc_len += 1
+
+    tail_start = LEAD_SIZE + crc_len
+    # FLAIR takes 8 digit lengths and offsets when the function does not fit 16 bits
+    width = 4 if end - start <= 0xFFFF else 8
+    parts = [lead, '%02X' % crc_len, '%04X' % crc16(value[LEAD_SIZE:tail_start]), '%0*X' % (width, end - start)]
+
+    publics = [l for l in sig['labels'] if start <= l['offset'] < end and psyq_db.LOCAL_LABEL_R.match(l['name']) is None]
+    for label in publics:
+        parts.append(':%0*X %s' % (width, label['offset'] - start, label['name']))
+
+    for call in sig['calls']:
+        if start <= call['offset'] < end:
+            parts.append('^%0*X %s' % (width, call['offset'] - start, call['name']))
+
+    if tail_start < len(value):
+        parts.append(hex_bytes(value[tail_start:], mask[tail_start:]))
+
+    return ' '.join(parts)
+
+
+def write_pat(sigs, out_path):
+    with open(out_path, 'w') as w:
+        for sig in sigs:
+            if 'section' in sig:
+                continue
+
+            for _, start, end in psyq_db.function_slices(sig):
+                w.write(pat_line(sig, start, end) + '\n')
+
+        w.write('---\n')
+
+
+def main(out_dir, db_path=psyq_scan.DB_PATH, versions=None):
+    # one psyq<ver>.pat per version, named like the til files
+    by_ver = dict()
+
+    for sig in psyq_scan.load_db(db_path, versions):
+        by_ver.setdefault(sig['ver'], list()).append(sig)
+
+    os.makedirs(out_dir, exist_ok=True)
+
+    for ver, sigs in by_ver.items():
+        write_pat(sigs, os.path.join(out_dir, 'psyq%s.pat' % ver))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Writes IDA FLIRT .pat files from the signature DB')
+    parser.add_argument('out_dir')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only these versions')
+    args = parser.parse_args()
+
+    main(args.out_dir, args.db, args.ver)
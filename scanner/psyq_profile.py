@@ -0,0 +1,141 @@
+import time
+import argparse
+
+import psyq_exe
+import psyq_scan
+import psyq_calls
+
+
+SORT_KEYS = ('time', 'candidates', 'outside', 'fails', 'bytes', 'hits', 'chosen')
+
+
+def mismatch_depth(view, start, group, full):
+    # offset of the first byte verify() rejects, the candidate lies within the binary
+    diff = (int.from_bytes(view[start:start + group['check']], 'little') ^ group['head_value']) & group['head_mask']
+
+    if not diff and full and group['check'] < group['size']:
+        diff = (int.from_bytes(view[start:start + group['size']], 'little') ^ group['value']) & group['mask']
+
+    return ((diff & -diff).bit_length() - 1) // 8
+
+
+def new_stats():
+    return {'candidates': 0, 'outside': 0, 'fails': 0, 'bytes': 0, 'depth': 0, 'time': 0.0, 'hits': 0, 'chosen': 0}
+
+
+def counting_verify(stats):
+    # psyq_scan.verify() counting, per group, candidates, bytes read, how deep the
+    # rejected ones got and the time spent verifying
+    clock = time.perf_counter
+
+    def check(view, start, group, full):
+        begin = clock()
+        found = psyq_scan.verify(view, start, group, full)
+        elapsed = clock() - begin
+
+        item = stats.get(id(group))
+        if item is None:
+            item = stats[id(group)] = dict(new_stats(), group=group)
+
+        item['candidates'] += 1
+        item['time'] += elapsed
+
+        if start < 0 or start + group['size'] > len(view):
+            # an anchor too close to either end, nothing is read
+            item['outside'] += 1
+        elif found:
+            item['bytes'] += group['size'] if full else group['check']
+            item['hits'] += len(group['sigs'])
+        else:
+            item['bytes'] += group['check']
+            item['fails'] += 1
+            item['depth'] += mismatch_depth(view, start, group, full)
+
+        return found
+
+    return check
+
+
+def profile(data, index, stats, base=0, ranges=None):
+    # one binary as psyq_scan.match() sees it: counters from the scan and the near
+    # verification of low specificity candidates, then which hits survive resolve()
+    check = counting_verify(stats)
+    deferred = list()
+    groups = dict((sig['id'], group) for group in index['groups'] for sig in group['sigs'])
+
+    hits = [hit for start, end in ranges or [(0, len(data))] for hit in psyq_scan.scan(data, index, start, end, deferred, check)]
+    hits.extend(psyq_scan.verify_near(data, index, deferred, hits, check))
+    hits = psyq_scan.complete(hits, data)
+    psyq_calls.cross_check(hits, data, base)
+
+    for hit in psyq_scan.resolve(psyq_scan.weigh(hits)):
+        stats[id(groups[hit['sig']['id']])]['chosen'] += 1
+
+
+def group_name(group):
+    sig = group['sigs'][0]
+    more = len(group['sigs']) - 1
+
+    return '%s %s/%s%s' % (sig['ver'], sig['lib'], sig['name'], ' +%d' % more if more else '')
+
+
+def lib_stats(stats):
+    # a group shared by several LIBs is counted once for each of them
+    libs = dict()
+
+    for item in stats.values():
+        for lib in set(sig['lib'] for sig in item['group']['sigs']):
+            total = libs.setdefault(lib, new_stats())
+
+            for k in total:
+                total[k] += item[k]
+
+    return libs
+
+
+def print_report(rows, sort, count, title):
+    header = '%10s %10s %8s %10s %12s %6s %8s %8s  %s'
+    line = '%10.1f %10d %8d %10d %12d %6.1f %8d %8d  %s'
+
+    print(title)
+    print(header % ('ms', 'candidates', 'outside', 'fails', 'bytes', 'depth', 'hits', 'chosen', 'name'))
+
+    for name, item in sorted(rows, key=lambda r: -r[1][sort])[:count]:
+        depth = item['depth'] / item['fails'] if item['fails'] else 0.0
+
+        print(line % (item['time'] * 1000, item['candidates'], item['outside'], item['fails'], item['bytes'], depth,
+                      item['hits'], item['chosen'], name))
+
+    print()
+
+
+def main(paths, db_path=psyq_scan.DB_PATH, versions=None, meta_path=None, full=False, sort='time', count=30,
+         manifest_path=None):
+    index = psyq_scan.build_index(psyq_scan.load_db(db_path, versions), psyq_scan.load_meta(meta_path), full)
+    manifest = psyq_exe.load_manifest(manifest_path)
+    stats = dict()
+
+    for path in paths:
+        with open(path, 'rb') as f:
+            # only the text of an EXE, as in psyq_scan.py
+            data, base, ranges = psyq_exe.load_input(f.read(), path, manifest)
+
+        profile(data, index, stats, base, ranges)
+
+    print_report([(group_name(item['group']), item) for item in stats.values()], sort, count, 'signatures')
+    print_report(list(lib_stats(stats).items()), sort, count, 'libraries')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Matcher cost per signature and per LIB')
+    parser.add_argument('paths', nargs='+')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-f', '--full', action='store_true', help='verify whole signatures, not only unique prefixes')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    parser.add_argument('-s', '--sort', default='time', choices=SORT_KEYS, help='column to sort by')
+    parser.add_argument('-n', '--count', type=int, default=30, help='rows per report')
+    args = parser.parse_args()
+
+    main(args.paths, args.db, args.ver, args.index, args.full, args.sort, args.count, args.manifest)
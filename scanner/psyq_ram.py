@@ -0,0 +1,148 @@
+import re
+import sys
+import gzip
+import json
+import argparse
+
+import psyq_scan
+
+
+RAM_BASE = 0x80000000
+RAM_SIZES = (0x200000, 0x800000)
+USER_START = 0x10000  # below is the kernel
+PAGE_SIZE = 0x1000
+CHUNK_SIZE = 0x100000
+
+# offset of main RAM in known uncompressed save state layouts, by header
+STATE_HEADERS = (
+    (b'STv4 PCSX', 32 + 4 + 1 + 128 * 96 * 3),
+)
+
+# kernel exception vector at 0x80: lui k0,hi / addiu k0,k0,lo / jr k0 / nop
+VECTOR_R = re.compile(b'..\x1a\x3c..\x5a\x27\x08\x00\x40\x03\x00\x00\x00\x00', re.DOTALL)
+VECTOR_OFFSET = 0x80
+
+
+def open_stream(path):
+    f = open(path, 'rb')
+    magic = f.read(2)
+    f.seek(0)
+
+    if magic == b'\x1f\x8b':
+        return gzip.GzipFile(fileobj=f)
+
+    return f
+
+
+def read_exact(f, buf, size):
+    while len(buf) < size:
+        chunk = f.read(max(CHUNK_SIZE, size - len(buf)))
+
+        if not chunk:
+            break
+
+        buf += chunk
+
+    return buf
+
+
+def locate_ram(f, ram_size, offset=None):
+    # keeps at most one RAM image plus one chunk in memory
+    buf = bytearray()
+
+    if offset is None:
+        buf = read_exact(f, buf, 16)
+
+        for header, state_offset in STATE_HEADERS:
+            if buf.startswith(header):
+                offset = state_offset
+                break
+
+    if offset is not None:
+        buf = read_exact(f, buf, offset + ram_size)
+        return bytes(buf[offset:offset + ram_size]) if len(buf) >= offset + ram_size else None
+
+    while True:
+        m = VECTOR_R.search(buf, VECTOR_OFFSET)
+
+        if m is not None:
+            start = m.start() - VECTOR_OFFSET
+            buf = read_exact(f, buf, start + ram_size)
+            return bytes(buf[start:start + ram_size]) if len(buf) >= start + ram_size else None
+
+        chunk = f.read(CHUNK_SIZE)
+
+        if not chunk:
+            return None
+
+        del buf[:max(0, len(buf) - VECTOR_OFFSET - 16)]
+        buf += chunk
+
+
+def load_ram(path, ram_size=RAM_SIZES[0], offset=None):
+    with open_stream(path) as f:
+        if offset is None:
+            data = f.read(RAM_SIZES[-1] + 1)
+
+            if len(data) in RAM_SIZES:
+                return data
+
+            f.seek(0)
+
+        return locate_ram(f, ram_size, offset)
+
+
+def code_ranges(data, start=USER_START):
+    # skips the kernel and pages that are blank or filled with one byte
+    ranges = list()
+
+    for pos in range(start, len(data), PAGE_SIZE):
+        page = data[pos:pos + PAGE_SIZE]
+
+        if page.count(page[:1]) == len(page):
+            continue
+
+        if ranges and ranges[-1][1] == pos:
+            ranges[-1][1] = pos + len(page)
+        else:
+            ranges.append([pos, pos + len(page)])
+
+    return ranges
+
+
+def scan_snapshot(args):
+    path, ram_size, offset = args
+    data = load_ram(path, ram_size, offset)
+
+    if data is None:
+        return {'snapshot': path, 'error': 'main RAM not found'}
+
+    return {
+        'snapshot': path,
+        'results': psyq_scan.match(data, psyq_scan.worker['index'], RAM_BASE, code_ranges(data))
+    }
+
+
+def main(paths, db_path=psyq_scan.DB_PATH, versions=None, jobs=None, ram_size=RAM_SIZES[0], offset=None, meta_path=None):
+    tasks = ((path, ram_size, offset) for path in paths)
+
+    # workers get one snapshot at a time, so memory stays bounded whatever the batch size
+    with psyq_scan.worker_pool(jobs, db_path, versions, meta_path, maxtasksperchild=256) as pool:
+        for item in pool.imap(scan_snapshot, tasks):
+            json.dump(item, sys.stdout)
+            sys.stdout.write('\n')
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Scans main RAM dumps and emulator save states')
+    parser.add_argument('paths', nargs='+')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-j', '--jobs', type=int, help='number of worker processes')
+    parser.add_argument('-s', '--size', type=lambda x: int(x, 0), default=RAM_SIZES[0], help='main RAM size')
+    parser.add_argument('-o', '--offset', type=lambda x: int(x, 0), help='RAM offset inside the (decompressed) file')
+    args = parser.parse_args()
+
+    main(args.paths, args.db, args.ver, args.jobs, args.size, args.offset, args.index)
@@ -0,0 +1,61 @@
+import struct
+from collections import Counter
+
+import psyq_calls
+
+
+ORI = 0x0D
+
+
+def sign16(word):
+    return (word & 0xFFFF) - ((word & 0x8000) << 1)
+
+
+def decode_relocs(hit, data):
+    # one pass over the relocations of a hit (sorted by offset, a HI comes before its LOs):
+    # (reloc, address) of every HI/LO or lui/ori pair, (reloc, $gp offset) of GP relative ones
+    his = dict()
+    pairs = list()
+    gps = list()
+
+    for rel in hit['sig'].get('relocs', ()):
+        word = struct.unpack_from('<I', data, hit['offset'] + rel['offset'])[0]
+
+        if 'hi' in rel:
+            if rel['hi'] in his:
+                lo = word & 0xFFFF if word >> 26 == ORI else sign16(word)
+                pairs.append((rel, (his[rel['hi']] + lo - rel['addend']) & 0xFFFFFFFF))
+        elif rel['type'] == 'GP':
+            gps.append((rel, sign16(word)))
+        else:
+            his[rel['offset']] = (word & 0xFFFF) << 16
+
+    return pairs, gps
+
+
+def global_labels(hits, data, base=0):
+    # names every global and BSS variable the chosen hits refer to that no hit labels yet
+    addrs, _ = psyq_calls.label_map(hits, base)
+    labels = dict()
+    pending = list()
+
+    for hit in hits:
+        pairs, gps = decode_relocs(hit, data)
+
+        for rel, address in pairs:
+            labels.setdefault(address, psyq_calls.symbol_name(hit, rel['name']))
+
+        pending.extend((psyq_calls.symbol_name(hit, rel['name']), rel, offset) for rel, offset in gps)
+
+    # $gp is not in the binary: it is the value most GP references agree on with the HI/LO ones
+    names = dict((name, address) for address, name in labels.items())
+    votes = Counter((names[name] + rel['addend'] - offset) & 0xFFFFFFFF
+                    for name, rel, offset in pending if name in names)
+
+    if votes:
+        gp = votes.most_common(1)[0][0]
+
+        for name, rel, offset in pending:
+            labels.setdefault((gp + offset - rel['addend']) & 0xFFFFFFFF, name)
+
+    return dict((address, name) for address, name in labels.items() if address not in addrs)
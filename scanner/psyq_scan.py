@@ -0,0 +1,590 @@
+import os
+import re
+import sys
+import json
+import array
+import struct
+import bisect
+import argparse
+import multiprocessing
+from collections import Counter
+
+import psyq_exe
+import psyq_toc
+import psyq_calls
+import psyq_approx
+import psyq_relocs
+import psyq_coverage
+
+
+VER_DIR_R = re.compile(r'^\d+$')
+HEX_BYTE_R = re.compile(r'[0-9A-Fa-f]{2}')
+DB_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+DATA_MIN_FIXED = 32  # shorter constant data matches by chance
+DATA_MIN_WORDS = 4  # distinct fixed words, blank tables make no anchors
+NEAR_DISTANCE = 0x2000  # low specificity signatures are looked for this close to other hits
+
+
+def parse_sig(text):
+    value = bytes.fromhex(text.replace('??', '00'))
+    mask = bytes.fromhex(HEX_BYTE_R.sub('FF', text).replace('??', '00'))
+
+    return value, mask
+
+
+def make_sig(ver, lib, idx, obj):
+    value, mask = parse_sig(obj['sig'])
+
+    return {
+        'id': '%s/%s/%d' % (ver, lib, idx),
+        'ver': ver,
+        'lib': lib,
+        'name': obj['name'],
+        'value': value,
+        'mask': mask,
+        'size': len(value),
+        'fixed': mask.count(0xFF),
+        'labels': obj['labels'],
+        'calls': obj.get('calls', list()),
+        'relocs': obj.get('relocs', list())
+    }
+
+
+def make_data_sigs(ver, lib, idx, obj):
+    # one signature per data section that is distinctive enough
+    sigs = list()
+
+    for block in obj.get('data', ()):
+        sig = make_sig(ver, lib, idx, {'name': obj['name'], 'sig': block['sig'], 'labels': block['labels']})
+        fixed = set(struct.unpack_from('<I', sig['value'], i)[0] for i in range(0, sig['size'] - 3, 4)
+                    if sig['mask'][i:i + 4] == b'\xFF\xFF\xFF\xFF')
+
+        if sig['fixed'] >= DATA_MIN_FIXED and len(fixed) >= DATA_MIN_WORDS:
+            sig['id'] += '/' + block['section']
+            sig['section'] = block['section']
+            sigs.append(sig)
+
+    return sigs
+
+
+def fixed_grams(value, mask):
+    # (offset, gram) of every 8-byte window on a word boundary without '??'
+    return [(i, struct.unpack_from('<Q', value, i)[0]) for i in range(0, len(value) - 7, 4)
+            if mask[i:i + 8] == b'\xFF' * 8]
+
+
+def data_grams(data):
+    # every 8-byte gram of the binary starting on a word boundary, as plain ints
+    # (an array, not struct tuples: 0.08 s instead of 0.11 s for 1.5 MB)
+    view = memoryview(data)
+    grams = set()
+
+    for start in (0, 4):
+        count = max(0, len(view) - start) // 8
+        values = array.array('Q')
+        values.frombytes(view[start:start + count * 8])
+        if sys.byteorder != 'little':
+            values.byteswap()
+        grams.update(values)
+
+    return grams
+
+
+def db_files(path, versions=None, libs=None):
+    files = list()
+
+    for ver in sorted(os.listdir(path), key=lambda v: v.ljust(4, '0')):
+        ver_path = os.path.join(path, ver)
+
+        if VER_DIR_R.match(ver) is None or not os.path.isdir(ver_path):
+            continue
+        if versions and ver not in versions:
+            continue
+
+        for name in sorted(os.listdir(ver_path)):
+            if name.endswith('.json') and (not libs or name[:-5] in libs):
+                files.append((ver, name[:-5], os.path.join(ver_path, name)))
+
+    return files
+
+
+def load_file(ver, lib, file_path):
+    # OBJs are read and decoded one at a time, the file is never held as a whole
+    sigs = list()
+    data_sigs = list()
+
+    for i, obj in enumerate(psyq_toc.iter_objs(file_path)):
+        if obj.get('sig'):
+            sigs.append(make_sig(ver, lib, i, obj))
+        data_sigs.extend(make_data_sigs(ver, lib, i, obj))
+
+    return sigs + data_sigs
+
+
+def load_db(path=DB_PATH, versions=None, libs=None):
+    sigs = list()
+
+    for ver, lib, file_path in db_files(path, versions, libs):
+        sigs.extend(load_file(ver, lib, file_path))
+
+    return sigs
+
+
+def build_index(sigs, meta=None, full=False):
+    # identical signatures from different versions are verified only once
+    groups = dict()
+
+    for sig in sigs:
+        key = (sig['value'], sig['mask'])
+        group = groups.get(key)
+
+        if group is None:
+            group = groups[key] = {
+                'size': sig['size'],
+                'value': int.from_bytes(sig['value'], 'little'),
+                'mask': int.from_bytes(sig['mask'], 'little'),
+                'sigs': list()
+            }
+
+        group['sigs'].append(sig)
+
+    # with psyq_db data only the bytes telling a group apart from the rest of the DB are compared
+    for group in groups.values():
+        check = group['size']
+
+        if meta is not None:
+            check = max(meta.get(sig['id'], dict()).get('prefix', check) for sig in group['sigs'])
+
+        head = (1 << (check * 8)) - 1
+        group['check'] = check
+        # fixed bytes a hit has been compared on, what it weighs
+        group['verified'] = group['sigs'][0]['mask'][:group['size'] if full else check].count(0xFF)
+        group['grams'] = list()
+        group['head_value'] = group['value'] & head
+        group['head_mask'] = group['mask'] & head
+        group['low'] = False
+
+        if meta is not None:
+            group['low'] = all(meta.get(sig['id'], dict()).get('low', False) for sig in group['sigs'])
+            grams = set(g for sig in group['sigs'] for g in meta.get(sig['id'], dict()).get('grams', ()))
+            group['grams'] = [int(g, 16) for g in sorted(grams)]
+
+    # anchor every group on its least common fully fixed word
+    freq = Counter()
+    words = dict()
+
+    for key, group in groups.items():
+        value, mask = key
+        fixed = [i for i in range(0, len(value) - 3, 4) if mask[i:i + 4] == b'\xFF\xFF\xFF\xFF']
+        words[key] = [(i, struct.unpack_from('<I', value, i)[0]) for i in fixed]
+        freq.update(w for _, w in words[key])
+
+    index = dict()
+    unindexed = list()
+
+    for key, group in groups.items():
+        if not words[key]:
+            unindexed.append(group)
+            continue
+
+        group['anchor'], word = min(words[key], key=lambda x: (freq[x[1]], x[0]))
+        index.setdefault(word, list()).append(group)
+
+    return {
+        'words': index,
+        'low': set(sig['id'] for g in groups.values() if g['low'] for sig in g['sigs']),
+        'groups': list(groups.values()),
+        'freq': freq,
+        'unindexed': unindexed,
+        'full': full,
+        'filtered': any(g['grams'] for g in groups.values()),
+        'max_size': max((g['size'] for g in groups.values()), default=0)
+    }
+
+
+def verify(view, start, group, full=False):
+    end = start + group['size']
+
+    if start < 0 or end > len(view):
+        return False
+
+    if int.from_bytes(view[start:start + group['check']], 'little') & group['head_mask'] != group['head_value']:
+        return False
+
+    if full and group['check'] < group['size']:
+        return int.from_bytes(view[start:end], 'little') & group['mask'] == group['value']
+
+    return True
+
+
+def group_hits(offset, group):
+    # a hit only compared on its prefix keeps its group, complete() checks the rest
+    hits = list()
+
+    for sig in group['sigs']:
+        hit = {'offset': offset, 'sig': sig, 'verified': group['verified']}
+
+        if group['verified'] < sig['fixed']:
+            hit['group'] = group
+        hits.append(hit)
+
+    return hits
+
+
+def complete(hits, data):
+    # the bytes after the prefix of the hits that have one, before they are weighed:
+    # a prefix is unique within the DB only, a hit weighs what has been compared
+    view = memoryview(data)
+    kept = list()
+
+    for hit in hits:
+        group = hit.get('group')
+
+        if group is not None:
+            start = hit['offset']
+
+            if int.from_bytes(view[start:start + group['size']], 'little') & group['mask'] != group['value']:
+                continue
+            hit = {'offset': start, 'sig': hit['sig'], 'verified': hit['sig']['fixed']}
+
+        kept.append(hit)
+
+    return kept
+
+
+def prefilter(data, index):
+    # drops the groups missing one of their required grams (from psyq_db) in the binary;
+    # collecting the grams costs more than the candidates it saves on any binary up to
+    # 2 MB with the whole DB (1.5 MB: 0.97 s without, 1.07 s with it), so it is opt-in
+    if not index['filtered']:
+        return index
+
+    grams = data_grams(data)
+    words = dict()
+
+    for word, groups in index['words'].items():
+        kept = [g for g in groups if all(gram in grams for gram in g['grams'])]
+
+        if kept:
+            words[word] = kept
+
+    return dict(index, words=words)
+
+
+def scan(data, index, start=0, end=None, deferred=None, check=verify):
+    # with deferred, the candidates of low specificity groups go there unverified;
+    # check replaces verify(), psyq_profile counts the candidates with it
+    view = memoryview(data)
+    words = index['words']
+    full = index['full']
+    hits = list()
+
+    if end is None:
+        end = len(view)
+
+    start &= ~3
+    end = min(end, len(view))
+    end = start + (max(0, end - start) & ~3)
+
+    for n, (word,) in enumerate(struct.iter_unpack('<I', view[start:end])):
+        groups = words.get(word)
+
+        if groups is None:
+            continue
+
+        pos = start + n * 4
+
+        for group in groups:
+            offset = pos - group['anchor']
+
+            if group['low'] and deferred is not None:
+                deferred.append((offset, group))
+            elif check(view, offset, group, full):
+                hits.extend(group_hits(offset, group))
+
+    return hits
+
+
+def near_ranges(hits, size):
+    # [start, end) around the hits, merged
+    ranges = list()
+
+    for start, end in sorted((max(0, hit['offset'] - NEAR_DISTANCE), min(size, hit['offset'] + hit['sig']['size'] + NEAR_DISTANCE))
+                             for hit in hits):
+        if ranges and start <= ranges[-1][1]:
+            ranges[-1][1] = max(ranges[-1][1], end)
+        else:
+            ranges.append([start, end])
+
+    return ranges
+
+
+def near_offsets(offsets, around, size):
+    # the indexes of the offsets close to one of the hits in around
+    ranges = near_ranges(around, size)
+    starts = [start for start, _ in ranges]
+    kept = list()
+
+    for n, offset in enumerate(offsets):
+        r = bisect.bisect_right(starts, offset) - 1
+
+        if r >= 0 and offset < ranges[r][1]:
+            kept.append(n)
+
+    return kept
+
+
+def near_hits(hits, around, size):
+    return [hits[n] for n in near_offsets([hit['offset'] for hit in hits], around, size)]
+
+
+def verify_near(data, index, deferred, hits, check=verify):
+    # the deferred low specificity candidates, verified only close to the other hits
+    view = memoryview(data)
+    found = list()
+
+    for n in near_offsets([offset for offset, _ in deferred], hits, len(data)):
+        offset, group = deferred[n]
+
+        if check(view, offset, group, index['full']):
+            found.extend(group_hits(offset, group))
+
+    return found
+
+
+def keep_near(hits, index, size):
+    # hits from a scan without deferring: drops the low specificity ones far from the others
+    if not index['low']:
+        return hits
+
+    others = [hit for hit in hits if hit['sig']['id'] not in index['low']]
+
+    return others + near_hits([hit for hit in hits if hit['sig']['id'] in index['low']], others, size)
+
+
+def weigh(hits):
+    # version consistency: share of all matched fixed bytes that agree on the version.
+    # A hit only counts the fixed bytes it was compared on, an unchecked tail proves nothing
+    votes = Counter()
+
+    for hit in hits:
+        votes[hit['sig']['ver']] += hit.get('verified', hit['sig']['fixed'])
+
+    top = max(votes.values(), default=1)
+
+    for hit in hits:
+        sig = hit['sig']
+        fixed = hit.get('verified', sig['fixed']) - hit.get('mismatched', 0)
+        hit['weight'] = fixed * (1.0 + votes[sig['ver']] / top) + hit.get('bonus', 0.0)
+
+    return hits
+
+
+def resolve(hits):
+    # weighted interval scheduling: best non-overlapping subset in O(n log n)
+    hits = sorted(hits, key=lambda h: (h['offset'] + h['sig']['size'], h['offset'], h['sig']['id']))
+    ends = [h['offset'] + h['sig']['size'] for h in hits]
+    best = [0.0] * (len(hits) + 1)
+    prev = [0] * len(hits)
+
+    for j, hit in enumerate(hits):
+        prev[j] = bisect.bisect_right(ends, hit['offset'], 0, j)
+        best[j + 1] = max(best[j], best[prev[j]] + hit['weight'])
+
+    chosen = list()
+    j = len(hits)
+
+    while j > 0:
+        if best[j] == best[j - 1]:
+            j -= 1
+        else:
+            chosen.append(hits[j - 1])
+            j = prev[j - 1]
+
+    chosen.reverse()
+
+    return chosen
+
+
+def results(hits, base=0, callees=None, variables=None, conflicts=None):
+    items = list()
+    callees = callees or dict()
+    variables = variables or dict()
+
+    for hit in hits:
+        sig = hit['sig']
+        items.append({
+            'address': base + hit['offset'],
+            'ver': sig['ver'],
+            'lib': sig['lib'],
+            'obj': sig['name'],
+            'size': sig['size'],
+            'labels': [{'name': l['name'], 'address': base + hit['offset'] + l['offset']} for l in sig['labels']]
+        })
+
+        if 'section' in sig:
+            items[-1]['section'] = sig['section']
+
+        if hit.get('patches'):
+            items[-1]['patches'] = hit['patches']
+
+    for address in sorted(callees):
+        items.append({'address': address, 'callee': callees[address]})
+
+    for address in sorted(variables):
+        if address not in callees:
+            items.append({'address': address, 'global': variables[address]})
+
+    items.extend(sorted(conflicts or (), key=lambda item: (item['address'], item['caller'])))
+
+    return items
+
+
+def print_results(items, as_json=False, out=sys.stdout):
+    if as_json:
+        json.dump(items, out, indent=4)
+        out.write('\n')
+        return
+
+    for item in items:
+        if 'callee' in item:
+            out.write('%08X %s (callee)\n' % (item['address'], item['callee']))
+            continue
+
+        if 'global' in item:
+            out.write('%08X %s (global)\n' % (item['address'], item['global']))
+            continue
+
+        if 'conflict' in item:
+            out.write('%08X %s (conflict: called from %08X, labelled %s)\n' % (
+                item['address'], item['conflict'], item['caller'], ', '.join(item['labels'])))
+            continue
+
+        section = ' .%s' % item['section'] if 'section' in item else ''
+        out.write('%08X %s %s/%s%s\n' % (item['address'], item['ver'], item['lib'], item['obj'], section))
+
+        for patch in item.get('patches', ()):
+            out.write('    patch pos %d: %s(was %s)\n' % (patch['pos'], patch['data'], patch['check']))
+
+        for label in item['labels']:
+            decl = '  %s' % label['type'] if 'type' in label else ''
+            out.write('    %08X %s%s\n' % (label['address'], label['name'], decl))
+
+
+def match(data, index, base=0, ranges=None, aindex=None, grams=False):
+    if aindex is not None:
+        scanner = lambda start, end: psyq_approx.scan_approx(data, aindex, start, end)
+    else:
+        # a bad word may break any gram, approximate matching goes without the filter
+        if grams:
+            index = prefilter(data, index)
+        scanner = lambda start, end: scan(data, index, start, end, deferred)
+
+    if ranges is None:
+        ranges = [(0, len(data))]
+
+    deferred = list()
+    hits = [hit for start, end in ranges for hit in scanner(start, end)]
+
+    if aindex is not None:
+        # the approximate scan defers nothing, its low specificity hits are dropped here
+        hits = keep_near(hits, index, len(data))
+    hits.extend(verify_near(data, index, deferred, hits))
+
+    return finish(hits, data, base)
+
+
+def finish(hits, data, base=0):
+    # raw hits to results: call checks, overlap resolution and callee labels
+    hits = complete(hits, data)
+    psyq_calls.cross_check(hits, data, base)
+    hits = resolve(weigh(hits))
+    callees, conflicts = psyq_calls.callee_labels(hits, data, base)
+
+    return results(hits, base, callees, psyq_relocs.global_labels(hits, data, base), conflicts)
+
+
+def load_meta(path):
+    if path is None:
+        return None
+
+    with open(path) as f:
+        return json.load(f)
+
+
+# the DB state of a worker process of psyq_batch, psyq_daemon, psyq_iso and psyq_ram
+worker = dict()
+
+
+def init_worker(db_path=DB_PATH, versions=None, meta_path=None, manifest_path=None):
+    # loaded once per process: a forked worker finds the state of its parent
+    if not worker:
+        sigs = load_db(db_path, versions)
+        worker['sigs'] = dict((sig['id'], sig) for sig in sigs)
+        worker['index'] = build_index(sigs, load_meta(meta_path))
+        worker['manifest'] = psyq_exe.load_manifest(manifest_path)
+
+    return worker
+
+
+def worker_pool(jobs, db_path=DB_PATH, versions=None, meta_path=None, manifest_path=None, **options):
+    # the index is built before forking, so workers share it read-only
+    args = (db_path, versions, meta_path, manifest_path)
+    init_worker(*args)
+
+    return multiprocessing.Pool(jobs, init_worker, args, **options)
+
+
+def main(path, db_path=DB_PATH, versions=None, base=None, as_json=False, meta_path=None, full=False, k=0, libs=None,
+         manifest_path=None, with_coverage=False, tix_dir=None, grams=False):
+    index = build_index(load_db(db_path, versions, libs), load_meta(meta_path), full)
+    aindex = psyq_approx.build_approx_index(index, k) if k else None
+
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    # a given base means a raw binary, else only the text of an EXE is scanned
+    ranges = [(0, len(data))]
+    if base is None:
+        data, base, ranges = psyq_exe.load_input(data, path, psyq_exe.load_manifest(manifest_path))
+
+    items = match(data, index, base, ranges, aindex, grams)
+
+    if tix_dir is not None:
+        # imported here, psyq_til uses this module to read the DB
+        import psyq_til
+        psyq_til.annotate(items, tix_dir)
+
+    if not with_coverage:
+        print_results(items, as_json)
+        return
+
+    cov = psyq_coverage.coverage(items, base + ranges[0][0], base + ranges[-1][1])
+
+    if as_json:
+        json.dump({'results': items, 'coverage': cov}, sys.stdout, indent=4)
+        sys.stdout.write('\n')
+    else:
+        print_results(items)
+        psyq_coverage.print_coverage(cov)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Finds PsyQ OBJ signatures in a binary')
+    parser.add_argument('path')
+    parser.add_argument('-d', '--db', default=DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-l', '--lib', action='append', help='only use these LIBs, e.g. -l LIBGTE.LIB')
+    parser.add_argument('-b', '--base', type=lambda x: int(x, 0), help='address of the first byte (default: from the EXE header)')
+    parser.add_argument('-m', '--manifest', help='json of overlay load addresses, {"file": address}')
+    parser.add_argument('-j', '--json', action='store_true', help='print results as json')
+    parser.add_argument('-i', '--index', help='index data built by psyq_db.py')
+    parser.add_argument('-f', '--full', action='store_true', help='verify whole signatures, not only unique prefixes')
+    parser.add_argument('-k', '--mismatches', type=int, default=0, help='accept up to k mismatching words')
+    parser.add_argument('-c', '--coverage', action='store_true', help='also report the identified share and the unidentified ranges')
+    parser.add_argument('-t', '--til', help='add C declarations to the labels from psyq<ver>.tix built by psyq_til.py')
+    parser.add_argument('-g', '--grams', action='store_true', help='drop the signatures missing a required gram first (needs -i)')
+    args = parser.parse_args()
+
+    main(args.path, args.db, args.ver, args.base, args.json, args.index, args.full, args.mismatches, args.lib, args.manifest,
+         args.coverage, args.til, args.grams)
@@ -0,0 +1,415 @@
+import os
+import re
+import mmap
+import zlib
+import struct
+import bisect
+import argparse
+
+import psyq_db
+import psyq_scan
+
+
+TIL_PATH = os.path.join(psyq_scan.DB_PATH, 'til')
+TIL_R = re.compile(r'^psyq(\d+)\.til$')
+TIL_ZIP = 0x0001
+TIX_MAGIC = b'PSYQTIX1'
+
+# IDA type string bytes
+BT_MASK = 0x0F
+BTMT_MASK = 0x30
+BTM_CONST = 0x40
+BTM_VOLATILE = 0x80
+BT_PTR = 0x0A
+BT_ARRAY = 0x0B
+BT_FUNC = 0x0C
+BT_COMPLEX = 0x0D
+BT_BITFIELD = 0x0E
+BTMT_NONBASED = 0x10
+BTMT_STRUCT, BTMT_UNION, BTMT_ENUM, BTMT_TYPEDEF = 0x00, 0x10, 0x20, 0x30
+CM_CC_MASK = 0xF0
+CM_CC_VOIDARG = 0x20
+CM_CC_ELLIPSIS = 0x40
+CM_CC_SPOILED = 0xA0
+TAH_BYTE = 0xFE  # type attributes
+FAH_BYTE = 0xFF  # function argument attributes
+TAH_HASATTRS = 0x0010
+
+BASE_TYPES = {
+    0x00: '_UNKNOWN', 0x10: '_UNKNOWN', 0x20: '_UNKNOWN', 0x30: '_UNKNOWN',
+    0x01: 'void', 0x11: '_BYTE', 0x21: '_WORD', 0x31: '_DWORD',
+    0x02: '__int8', 0x12: 'signed char', 0x22: 'unsigned char', 0x32: 'char',
+    0x03: 'short', 0x13: 'signed short', 0x23: 'unsigned short', 0x33: 'short',
+    0x04: 'long', 0x14: 'signed long', 0x24: 'unsigned long', 0x34: 'long',
+    0x05: '__int64', 0x15: 'signed __int64', 0x25: 'unsigned __int64', 0x35: '__int64',
+    0x06: '__int128', 0x16: 'signed __int128', 0x26: 'unsigned __int128', 0x36: '__int128',
+    0x07: 'int', 0x17: 'signed int', 0x27: 'unsigned int', 0x37: 'int',
+    0x08: 'bool', 0x18: 'bool', 0x28: 'bool', 0x38: 'bool',
+    0x09: 'float', 0x19: 'double', 0x29: 'long double', 0x39: '_TBYTE',
+}
+
+
+class TypeReader(object):
+    # decodes one IDA type string into a small tree: ('base', name), ('ref', name),
+    # ('ptr', t), ('array', n, t), ('func', ret, args, variadic), ('struct'|'union', members),
+    # ('enum', count), ('bitfield', bits), each with a prefix of const/volatile
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise ValueError('truncated type')
+
+        b = self.data[self.pos]
+        self.pos += 1
+
+        return b
+
+    def dt(self):
+        value = self.byte()
+
+        if value & 0x80:
+            value = (value & 0x7F) | (self.byte() << 7)
+
+        return value - 1
+
+    def de(self):
+        value = 0
+
+        while True:
+            b = self.byte()
+
+            if not b & 0x80:
+                return (value << 6) | (b & 0x3F)
+
+            value = (value << 7) | (b & 0x7F)
+
+    def attributes(self):
+        # optional type attribute block: bits, then key/value pairs
+        attrs = dict()
+
+        if self.pos < len(self.data) and self.data[self.pos] == TAH_BYTE:
+            self.pos += 1
+
+            if self.de() & TAH_HASATTRS:
+                for _ in range(self.dt()):
+                    key = self.pstring()
+                    attrs[key] = self.pstring()
+
+        return attrs
+
+    def pstring(self):
+        size = self.dt()
+        text = self.data[self.pos:self.pos + size].decode('ascii', 'replace')
+        self.pos += size
+
+        return text
+
+    def read(self):
+        t = self.byte()
+
+        if t == FAH_BYTE:
+            self.de()
+            t = self.byte()
+        bt, mt = t & BT_MASK, t & BTMT_MASK
+        mods = ('const ' if t & BTM_CONST else '') + ('volatile ' if t & BTM_VOLATILE else '')
+
+        if bt < BT_PTR:
+            return mods, ('base', BASE_TYPES[bt | mt])
+
+        if bt == BT_PTR:
+            if mt == 0x30:
+                raise ValueError('closure pointer')
+            attrs = self.attributes()
+            target = self.read()
+
+            # a pointer written with a typedef name in the header
+            if '__org_typedef' in attrs:
+                return mods, ('ref', attrs['__org_typedef'])
+
+            return mods, ('ptr', target)
+
+        if bt == BT_ARRAY:
+            if not mt & BTMT_NONBASED:
+                raise ValueError('based array')
+            return mods, ('array', self.dt(), self.read())
+
+        if bt == BT_FUNC:
+            cm = self.byte()
+            cc = cm & CM_CC_MASK
+
+            if cc >= CM_CC_SPOILED:
+                raise ValueError('calling convention %02X' % cm)
+
+            ret = self.read()
+            args = list()
+
+            if cc != CM_CC_VOIDARG:
+                args = [self.read() for _ in range(self.dt())]
+
+            return mods, ('func', ret, args, cc == CM_CC_ELLIPSIS)
+
+        if bt == BT_COMPLEX:
+            if mt == BTMT_TYPEDEF:
+                return mods, ('ref', self.pstring())
+
+            count = self.dt()
+            kind = {BTMT_STRUCT: 'struct', BTMT_UNION: 'union', BTMT_ENUM: 'enum'}[mt]
+
+            if count == 0:
+                return mods, ('ref', '%s %s' % (kind, self.pstring()))
+
+            if mt == BTMT_ENUM:
+                # member values are not needed for names and prototypes
+                self.pos = len(self.data)
+                return mods, ('enum', count)
+
+            return mods, (kind, [self.read() for _ in range(count >> 3)])
+
+        if bt == BT_BITFIELD:
+            return mods, ('bitfield', self.dt() >> 1)
+
+        raise ValueError('type byte %02X' % t)
+
+
+def render(t, decl='', names=()):
+    mods, node = t
+    kind = node[0]
+
+    if kind in ('base', 'ref'):
+        return ('%s%s %s' % (mods, node[1], decl)).strip()
+
+    if kind == 'ptr':
+        inner = node[1][1][0]
+        return render(node[1], '(*%s%s)' % (mods, decl) if inner in ('func', 'array') else '*%s%s' % (mods, decl))
+
+    if kind == 'array':
+        return render(node[2], '%s[%d]' % (decl, node[1]))
+
+    if kind == 'func':
+        args = [render(a, names[i] if i < len(names) else '') for i, a in enumerate(node[2])]
+        if node[3]:
+            args.append('...')
+        return render(node[1], '%s(%s)' % (decl, ', '.join(args) or 'void'))
+
+    if kind in ('struct', 'union'):
+        members = ''.join('%s; ' % render(m, names[i] if i < len(names) else '') for i, m in enumerate(node[1]))
+        return ('%s%s { %s} %s' % (mods, kind, members, decl)).strip()
+
+    if kind == 'enum':
+        return ('%senum { %s } %s' % (mods, ', '.join(names), decl)).strip()
+
+    return ('%sint %s : %d' % (mods, decl, node[1])).strip()
+
+
+def read_buckets(data):
+    # header: form, flags, title, base, then id, cm, sizes and alignment
+    pos = 6
+    _, flags = struct.unpack_from('<II', data, pos)
+    pos += 8
+    pos += 1 + data[pos]
+    pos += 1 + data[pos]
+    pos += 6
+
+    buckets = list()
+
+    for _ in range(2):
+        count, size = struct.unpack_from('<II', data, pos)
+        pos += 8
+
+        if flags & TIL_ZIP:
+            csize = struct.unpack_from('<I', data, pos)[0]
+            raw = zlib.decompress(data[pos + 4:pos + 4 + csize])
+            pos += 4 + csize
+        else:
+            raw = data[pos:pos + size]
+            pos += size
+
+        buckets.append((count, raw))
+
+    return buckets
+
+
+def entries(count, raw):
+    # flags, name, ordinal, type, comment, field names, field comments, storage class
+    pos = 0
+
+    for _ in range(count):
+        pos += 4
+        end = raw.index(b'\x00', pos)
+        name = raw[pos:end].decode('ascii', 'replace')
+        pos = end + 5
+
+        fields = list()
+        strings = list()
+
+        for _ in range(4):
+            end = raw.index(b'\x00', pos)
+            strings.append(raw[pos:end])
+            pos = end + 1
+
+        reader = TypeReader(strings[2])
+        while reader.pos < len(reader.data):
+            fields.append(reader.pstring())
+
+        pos += 1
+
+        yield name, strings[0], fields
+
+
+def read_til(path):
+    # name -> C declaration of every symbol and named type
+    with open(path, 'rb') as f:
+        (sym_count, syms), (type_count, types) = read_buckets(f.read())
+
+    items = dict()
+
+    for name, type_str, fields in entries(sym_count, syms):
+        names = ['' if f.startswith('$') else f for f in fields]
+        try:
+            items[name] = render(TypeReader(type_str).read(), name, names) + ';'
+        except (ValueError, KeyError, IndexError):
+            items[name] = '/* ? */ %s;' % name
+
+    # anonymous structs ('$' + hash) are written inline in the typedefs naming them
+    anonymous = dict()
+    named = list()
+
+    for name, type_str, fields in entries(type_count, types):
+        if name.startswith('$'):
+            anonymous[name] = (type_str, fields)
+        else:
+            named.append((name, type_str, fields))
+
+    for name, type_str, fields in named:
+        try:
+            t = TypeReader(type_str).read()
+
+            kind = t[1][0]
+
+            if kind == 'ref' and t[1][1].split()[-1] in anonymous:
+                body, body_fields = anonymous[t[1][1].split()[-1]]
+                items.setdefault(name, 'typedef %s;' % render(TypeReader(body).read(), name, body_fields))
+            elif kind in ('struct', 'union', 'enum'):
+                # a tagged type, not a typedef
+                items.setdefault(name, render(t, '', fields).replace(kind, '%s %s' % (kind, name), 1) + ';')
+            else:
+                items.setdefault(name, 'typedef %s;' % render(t, name, fields))
+        except (ValueError, KeyError, IndexError):
+            items.setdefault(name, '/* ? */ typedef %s;' % name)
+
+    return items
+
+
+def write_index(items, path):
+    # sorted (name offset, text offset) table, then NUL terminated strings; searched in place
+    names = sorted(items)
+    blob = bytearray()
+    table = list()
+    start = len(TIX_MAGIC) + 4 + 8 * len(names)
+
+    for name in names:
+        table.append(start + len(blob))
+        blob += name.encode() + b'\x00'
+        table.append(start + len(blob))
+        blob += items[name].encode() + b'\x00'
+
+    with open(path, 'wb') as w:
+        w.write(TIX_MAGIC + struct.pack('<I', len(names)))
+        w.write(struct.pack('<%dI' % len(table), *table))
+        w.write(blob)
+
+
+class TypeIndex(object):
+    def __init__(self, path):
+        self.f = open(path, 'rb')
+        self.data = mmap.mmap(self.f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        if self.data[:len(TIX_MAGIC)] != TIX_MAGIC:
+            self.close()
+            raise ValueError('%s: not a type index' % path)
+
+        self.count = struct.unpack_from('<I', self.data, len(TIX_MAGIC))[0]
+
+    def close(self):
+        self.data.close()
+        self.f.close()
+
+    def string(self, offset):
+        return self.data[offset:self.data.find(b'\x00', offset)]
+
+    def __len__(self):
+        return self.count
+
+    def __getitem__(self, i):
+        return self.string(struct.unpack_from('<I', self.data, len(TIX_MAGIC) + 4 + 8 * i)[0])
+
+    def get(self, name, default=None):
+        key = name.encode()
+        i = bisect.bisect_left(self, key)
+
+        if i < self.count and self[i] == key:
+            offset = struct.unpack_from('<I', self.data, len(TIX_MAGIC) + 8 + 8 * i)[0]
+            return self.string(offset).decode()
+
+        return default
+
+
+def index_path(out_dir, ver):
+    return os.path.join(out_dir, 'psyq%s.tix' % ver)
+
+
+def annotate(items, out_dir):
+    # adds the C declaration to every label of scan results that has one
+    indexes = dict()
+
+    for item in items:
+        if 'ver' not in item:
+            continue
+
+        if item['ver'] not in indexes:
+            path = index_path(out_dir, item['ver'])
+            indexes[item['ver']] = TypeIndex(path) if os.path.exists(path) else None
+
+        index = indexes[item['ver']]
+        for label in item['labels'] if index is not None else ():
+            decl = index.get(label['name'])
+            if decl is not None:
+                label['type'] = decl
+
+    for index in indexes.values():
+        if index is not None:
+            index.close()
+
+    return items
+
+
+def main(out_dir, til_path=TIL_PATH, db_path=psyq_scan.DB_PATH, versions=None):
+    os.makedirs(out_dir, exist_ok=True)
+
+    for name in sorted(os.listdir(til_path)):
+        m = TIL_R.match(name)
+
+        if m is None or (versions and m.group(1) not in versions):
+            continue
+
+        ver = m.group(1)
+        items = read_til(os.path.join(til_path, name))
+        write_index(items, index_path(out_dir, ver))
+
+        # how many function labels of this version's signatures get a declaration
+        labels = set(l['name'] for sig in psyq_scan.load_db(db_path, [ver]) for l in sig['labels']
+                     if psyq_db.LOCAL_LABEL_R.match(l['name']) is None)
+        print('%s: %d declarations, %d of %d labels' % (ver, len(items), len(labels & set(items)), len(labels)))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Builds name -> C declaration indexes from til/psyq*.til')
+    parser.add_argument('out_dir')
+    parser.add_argument('-t', '--til', default=TIL_PATH, help='directory of psyq<ver>.til')
+    parser.add_argument('-d', '--db', default=psyq_scan.DB_PATH, help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only these versions')
+    args = parser.parse_args()
+
+    main(args.out_dir, args.til, args.db, args.ver)
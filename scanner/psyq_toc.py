@@ -0,0 +1,73 @@
+import os
+import re
+import json
+import argparse
+
+
+DECODER = json.JSONDecoder()
+SEPARATOR_R = re.compile(r'[\s,]*')
+CHUNK_SIZE = 0x40000
+
+
+def iter_objs(path):
+    # every OBJ of a DB file, one at a time: the file is read in chunks and the C
+    # scanner of the json module decodes each object, nothing is kept between them
+    # (a json file has no offset table, an OBJ is only found by reading up to it)
+    with open(path, encoding='utf-8') as f:
+        text = ''
+        pos = 0
+        opened = False
+
+        while True:
+            pos = SEPARATOR_R.match(text, pos).end()
+
+            if pos == len(text):
+                text = f.read(CHUNK_SIZE)
+                pos = 0
+                if not text:
+                    return
+                continue
+
+            if not opened:
+                if text[pos] != '[':
+                    return
+                opened = True
+                pos += 1
+                continue
+
+            if text[pos] == ']':
+                return
+
+            try:
+                obj, end = DECODER.raw_decode(text, pos)
+            except ValueError:
+                # an object cut at the end of the chunk, decoded again with the next one
+                more = f.read(CHUNK_SIZE)
+                if not more:
+                    raise
+                text = text[pos:] + more
+                pos = 0
+                continue
+
+            yield obj
+            pos = end
+
+
+def main(db_path, versions=None, libs=None):
+    # imported here, psyq_scan uses this module to load the DB
+    import psyq_scan
+
+    for ver, lib, path in psyq_scan.db_files(db_path, versions, libs):
+        for obj in iter_objs(path):
+            print('%s %s %s %d' % (ver, lib, obj.get('name'), len(obj.get('sig', '').split())))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Lists the OBJs of the DB files and their sizes, read one at a time')
+    parser.add_argument('-d', '--db', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'),
+                        help='signatures root (with <ver>/*.json)')
+    parser.add_argument('-v', '--ver', action='append', help='only use these versions, e.g. -v 460 -v 470')
+    parser.add_argument('-l', '--lib', action='append', help='only use these LIBs, e.g. -l LIBGTE.LIB')
+    args = parser.parse_args()
+
+    main(args.db, args.ver, args.lib)